@@ -0,0 +1,132 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Allocator for things living as long as the program: parse tree
+ * Nodes, symbol table Cells, their names and constant strings.
+ *
+ * Memory is carved out of large chunks by bumping a pointer, so that
+ * the tree walked by execute() sits in a few contiguous pages instead
+ * of being scattered in the heap.  Nothing is ever freed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "awk.h"
+
+#define	ARENASIZE	(64 * 1024)	/* size of a chunk */
+#define	ARENAALIGN	sizeof(double)	/* alignment of allocations */
+
+static char	*apos = NULL;		/* free space of the current chunk */
+static size_t	 aleft = 0;
+
+/*
+ * return `size' bytes of zeroed memory
+ */
+void *
+arena_alloc(size_t size)
+{
+	void *p;
+
+	size = (size + ARENAALIGN - 1) & ~(ARENAALIGN - 1);
+	if (size > aleft) {
+		/* don't waste the current chunk for a big object */
+		if (size > ARENASIZE / 4)
+			return xcalloc(1, size);
+		apos = xcalloc(1, ARENASIZE);
+		aleft = ARENASIZE;
+	}
+	p = apos;
+	apos += size;
+	aleft -= size;
+	return p;
+}
+
+char *
+arena_strdup(const char *s)
+{
+	size_t len = strlen(s);
+
+	return memcpy(arena_alloc(len + 1), s, len + 1);
+}
+
+/*
+ * Scratch space for the strings of temporary Cells.  It is reset when
+ * the next record is loaded, at which point no temporary is alive:
+ * a value that outlives its record has been copied by sval_set().
+ *
+ * If the current chunk is full, a twice larger one is used until the
+ * reset, which then replaces both by a chunk of the total size.  In
+ * the steady state no memory is allocated.
+ */
+struct tchunk {
+	struct tchunk	*next;
+	size_t		 size;
+	size_t		 used;
+	char		 mem[1];
+};
+
+#define	TCHUNKSIZE	(16 * 1024)
+
+static struct tchunk	*tcur = NULL;
+
+void *
+tmp_alloc(size_t size)
+{
+	struct tchunk *c;
+	size_t n;
+	void *p;
+
+	size = (size + ARENAALIGN - 1) & ~(ARENAALIGN - 1);
+	if (tcur == NULL || tcur->size - tcur->used < size) {
+		n = tcur ? tcur->size * 2 : TCHUNKSIZE;
+		while (n < size)
+			n *= 2;
+		c = xmalloc(sizeof(*c) + n);
+		c->next = tcur;
+		c->size = n;
+		c->used = 0;
+		tcur = c;
+	}
+	p = tcur->mem + tcur->used;
+	tcur->used += size;
+	return p;
+}
+
+void
+tmp_reset(void)
+{
+	struct tchunk *c;
+	size_t n;
+
+	if (tcur == NULL)
+		return;
+	if (tcur->next != NULL) {
+		for (n = 0, c = tcur; c != NULL; c = tcur) {
+			n += c->size;
+			tcur = c->next;
+			free(c);
+		}
+		tcur = xmalloc(sizeof(*tcur) + n);
+		tcur->next = NULL;
+		tcur->size = n;
+	}
+	tcur->used = 0;
+}
@@ -0,0 +1,479 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Associative arrays.
+ *
+ * The map is an open addressing table in the spirit of SwissTable.
+ * Slots are organised in groups of AGROUP, each slot having a control
+ * byte that is either EMPTY, DELETED or the low 7 bits of the hash of
+ * its key.  A lookup compares the control bytes of a whole group at
+ * once, and only looks at the slots whose bits match.  Keys shorter
+ * than AKEYLEN are stored inline in the slot.
+ *
+ * Growing is incremental: a new table is allocated and each following
+ * insertion or deletion moves one group of the old table into it, so
+ * no single operation rehashes the whole array.
+ *
+ * Elements are Values allocated out of line, so that pointers returned
+ * by amap_get() stay valid while the table moves.  Expressions see
+ * them through an Elem, a Cell that is stored back when released.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "awk.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define	AGROUP		16	/* slots per group */
+#define	AKEYLEN		16	/* keys shorter than this are inline */
+#define	AMIGRATE	1	/* groups moved per insertion */
+#define	AVALS		512	/* element Values allocated at once */
+#define	AELEMS		16	/* Elems allocated at once */
+
+#define	CEMPTY		0x80
+#define	CDELETED	0xfe
+#define	isfull(c)	(((c) & 0x80) == 0)
+
+#define	H1(h)		((h) >> 7)
+#define	H2(h)		((uint8_t)((h) & 0x7f))
+
+struct aslot {
+	uint64_t	 hash;
+	uint32_t	 len;
+	union {
+		char	 in[AKEYLEN];
+		char	*out;
+	} key;
+	Value		*val;
+};
+
+#define	akey(s)		((s)->len < AKEYLEN ? (s)->key.in : (s)->key.out)
+
+struct atab {
+	uint8_t		*ctrl;		/* control bytes, one per slot */
+	struct aslot	*slots;
+	size_t		 ngroups;	/* a power of 2 */
+	size_t		 nused;		/* full and deleted slots */
+};
+
+struct amap {
+	struct atab	 cur;		/* where new keys go */
+	struct atab	 old;		/* being migrated if old.ctrl != NULL */
+	size_t		 oldpos;	/* next group of old to migrate */
+	size_t		 nelem;
+};
+
+Value		*freevals;	/* free element Values, chained */
+struct elem	**freeelems;	/* free Elems */
+int		 nfreeelems, elemssize;
+struct elem	**elemblks;	/* all the Elems, by AELEMS */
+
+void		 atab_init(struct atab *, size_t);
+struct aslot	*atab_find(struct atab *, const char *, size_t, uint64_t);
+struct aslot	*atab_insert(struct atab *, uint64_t);
+void		 amap_grow(struct amap *);
+void		 amap_migrate(struct amap *, int);
+void		 aslot_free(struct aslot *);
+Value		*aval_get(void);
+void		 aval_put(Value *);
+
+/*
+ * bitmask of the slots of group g whose control byte is c
+ */
+static inline unsigned
+group_match(const uint8_t *g, uint8_t c)
+{
+#ifdef __SSE2__
+	__m128i v = _mm_loadu_si128((const __m128i *)g);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+#else
+	unsigned m = 0;
+	int i;
+
+	for (i = 0; i < AGROUP; i++)
+		m |= (unsigned)(g[i] == c) << i;
+	return m;
+#endif
+}
+
+/*
+ * bitmask of the slots of group g that are empty or deleted
+ */
+static inline unsigned
+group_free(const uint8_t *g)
+{
+#ifdef __SSE2__
+	__m128i v = _mm_loadu_si128((const __m128i *)g);
+
+	return _mm_movemask_epi8(v);
+#else
+	unsigned m = 0;
+	int i;
+
+	for (i = 0; i < AGROUP; i++)
+		m |= (unsigned)!isfull(g[i]) << i;
+	return m;
+#endif
+}
+
+struct amap *
+amap_alloc(void)
+{
+	struct amap *ap;
+
+	ap = xcalloc(1, sizeof(*ap));
+	atab_init(&ap->cur, 1);
+	return ap;
+}
+
+void
+atab_init(struct atab *t, size_t ngroups)
+{
+	t->ctrl = xmalloc(ngroups * AGROUP);
+	memset(t->ctrl, CEMPTY, ngroups * AGROUP);
+	t->slots = xcalloc(ngroups * AGROUP, sizeof(struct aslot));
+	t->ngroups = ngroups;
+	t->nused = 0;
+}
+
+/*
+ * look for key k of length len and hash h in t
+ */
+struct aslot *
+atab_find(struct atab *t, const char *k, size_t len, uint64_t h)
+{
+	size_t g, mask = t->ngroups - 1, step = 0;
+	struct aslot *s;
+	unsigned m;
+	int i;
+
+	for (g = H1(h) & mask; ; g = (g + ++step) & mask) {
+		m = group_match(t->ctrl + g * AGROUP, H2(h));
+		while (m != 0) {
+			i = __builtin_ctz(m);
+			s = &t->slots[g * AGROUP + i];
+			if (s->hash == h && s->len == len &&
+			    memcmp(akey(s), k, len) == 0)
+				return s;
+			m &= m - 1;
+		}
+		if (group_match(t->ctrl + g * AGROUP, CEMPTY) != 0)
+			return NULL;
+		if (step >= mask)
+			return NULL;	/* visited every group */
+	}
+}
+
+/*
+ * take a free slot for hash h in t
+ */
+struct aslot *
+atab_insert(struct atab *t, uint64_t h)
+{
+	size_t g, mask = t->ngroups - 1, step = 0;
+	uint8_t *c;
+	unsigned m;
+	int i;
+
+	for (g = H1(h) & mask; ; g = (g + ++step) & mask) {
+		if ((m = group_free(t->ctrl + g * AGROUP)) != 0)
+			break;
+	}
+	i = __builtin_ctz(m);
+	c = &t->ctrl[g * AGROUP + i];
+	if (*c == CEMPTY)
+		t->nused++;
+	*c = H2(h);
+	return &t->slots[g * AGROUP + i];
+}
+
+/*
+ * return the element of key k, creating it if asked to
+ */
+Value *
+amap_get(struct amap *ap, const char *k, int create)
+{
+	struct aslot *s;
+	size_t len = strlen(k);
+	uint64_t h;
+
+	h = hash(k, len);
+	if ((s = atab_find(&ap->cur, k, len, h)) != NULL)
+		return s->val;
+	if (ap->old.ctrl != NULL &&
+	    (s = atab_find(&ap->old, k, len, h)) != NULL)
+		return s->val;
+	if (!create)
+		return NULL;
+
+	if (ap->old.ctrl != NULL)
+		amap_migrate(ap, AMIGRATE);
+	/* keep at least one empty slot in 8 */
+	if ((ap->cur.nused + 1) * 8 > ap->cur.ngroups * AGROUP * 7)
+		amap_grow(ap);
+	s = atab_insert(&ap->cur, h);
+	s->hash = h;
+	s->len = len;
+	if (len < AKEYLEN)
+		memcpy(s->key.in, k, len + 1);
+	else
+		s->key.out = xstrdup(k);
+	s->val = aval_get();
+	ap->nelem++;
+	return s->val;
+}
+
+void
+amap_delete(struct amap *ap, const char *k)
+{
+	struct atab *t = &ap->cur;
+	struct aslot *s;
+	size_t len = strlen(k);
+	uint64_t h;
+
+	h = hash(k, len);
+	if ((s = atab_find(t, k, len, h)) == NULL && ap->old.ctrl != NULL) {
+		t = &ap->old;
+		s = atab_find(t, k, len, h);
+	}
+	if (s == NULL)
+		return;
+	t->ctrl[s - t->slots] = CDELETED;
+	aslot_free(s);
+	ap->nelem--;
+	if (ap->old.ctrl != NULL)
+		amap_migrate(ap, AMIGRATE);
+}
+
+/*
+ * start moving the elements to a new table
+ */
+void
+amap_grow(struct amap *ap)
+{
+	size_t n;
+
+	/* the previous migration must be over */
+	if (ap->old.ctrl != NULL)
+		amap_migrate(ap, ap->old.ngroups);
+	/* double, unless there's mostly deleted slots */
+	n = ap->cur.ngroups;
+	if (ap->nelem * 16 >= n * AGROUP * 7)
+		n *= 2;
+	ap->old = ap->cur;
+	ap->oldpos = 0;
+	atab_init(&ap->cur, n);
+	   DPRINTF("amap_grow %p: %zu elements, %zu groups\n",
+		(void *)ap, ap->nelem, n);
+}
+
+/*
+ * move up to n groups from the old table to the current one
+ *
+ * moved slots are marked deleted, not empty, so that lookups of keys
+ * not moved yet still probe past them.
+ */
+void
+amap_migrate(struct amap *ap, int n)
+{
+	struct atab *o = &ap->old;
+	struct aslot *s, *d;
+	size_t i, end;
+
+	for (; n > 0 && ap->oldpos < o->ngroups; n--, ap->oldpos++) {
+		end = (ap->oldpos + 1) * AGROUP;
+		for (i = ap->oldpos * AGROUP; i < end; i++) {
+			if (!isfull(o->ctrl[i]))
+				continue;
+			s = &o->slots[i];
+			d = atab_insert(&ap->cur, s->hash);
+			*d = *s;
+			o->ctrl[i] = CDELETED;
+		}
+	}
+	if (ap->oldpos == o->ngroups) {
+		free(o->ctrl);
+		free(o->slots);
+		memset(o, 0, sizeof(*o));
+	}
+}
+
+void
+aslot_free(struct aslot *s)
+{
+	if (s->len >= AKEYLEN)
+		free(s->key.out);
+	aval_put(s->val);
+	s->val = NULL;
+}
+
+/*
+ * delete all elements
+ */
+void
+amap_clear(struct amap *ap)
+{
+	struct atab *t;
+	size_t i;
+
+	for (t = &ap->cur; t != NULL; t = (t == &ap->cur ? &ap->old : NULL)) {
+		if (t->ctrl == NULL)
+			continue;
+		for (i = 0; i < t->ngroups * AGROUP; i++) {
+			if (isfull(t->ctrl[i]))
+				aslot_free(&t->slots[i]);
+		}
+		free(t->ctrl);
+		free(t->slots);
+		memset(t, 0, sizeof(*t));
+	}
+	ap->nelem = 0;
+	atab_init(&ap->cur, 1);
+}
+
+/*
+ * copy all the keys, \0 separated, in a buffer returned in *bufp
+ *
+ * the caller must free it.  Returns the number of keys.
+ */
+size_t
+amap_keys(struct amap *ap, char **bufp)
+{
+	struct atab *t;
+	size_t i, n = 0, sz = 1;
+	char *p;
+
+	for (t = &ap->cur; t != NULL; t = (t == &ap->cur ? &ap->old : NULL)) {
+		for (i = 0; i < t->ngroups * AGROUP; i++) {
+			if (t->ctrl != NULL && isfull(t->ctrl[i]))
+				sz += t->slots[i].len + 1;
+		}
+	}
+	p = *bufp = xmalloc(sz);
+	for (t = &ap->cur; t != NULL; t = (t == &ap->cur ? &ap->old : NULL)) {
+		for (i = 0; i < t->ngroups * AGROUP; i++) {
+			if (t->ctrl == NULL || !isfull(t->ctrl[i]))
+				continue;
+			memcpy(p, akey(&t->slots[i]), t->slots[i].len + 1);
+			p += t->slots[i].len + 1;
+			n++;
+		}
+	}
+	return n;
+}
+
+Value *
+aval_get(void)
+{
+	Value *v;
+	int i;
+
+	if (freevals == NULL) {
+		v = xcalloc(AVALS, sizeof(Value));
+		for (i = 1; i < AVALS; i++)
+			v[i-1] = (uintptr_t)&v[i];
+		v[i-1] = 0;
+		freevals = v;
+	}
+	v = freevals;
+	freevals = (Value *)(uintptr_t)*v;
+	*v = VEMPTY;
+	return v;
+}
+
+void
+aval_put(Value *v)
+{
+	value_free(*v);
+	*v = (uintptr_t)freevals;
+	freevals = v;
+}
+
+/*
+ * return a Cell standing for the element v
+ */
+Cell *
+elem_get(Value *v)
+{
+	struct elem *e;
+	int i;
+
+	if (nfreeelems == 0) {
+		e = xcalloc(AELEMS, sizeof(*e));
+		elemblks = xreallocarray(elemblks, elemssize / AELEMS + 1,
+		    sizeof(struct elem *));
+		elemblks[elemssize / AELEMS] = e;
+		elemssize += AELEMS;
+		freeelems = xreallocarray(freeelems, elemssize,
+		    sizeof(struct elem *));
+		for (i = 0; i < AELEMS; i++)
+			freeelems[nfreeelems++] = &e[i];
+	}
+	e = freeelems[--nfreeelems];
+	e->cell.ctype = CELEM;
+	e->cell.cnum = -1;
+	e->val = v;
+	e->dirty = 0;
+	value_load(&e->cell, *v);
+	return &e->cell;
+}
+
+/*
+ * release an Elem, storing its value if it has been assigned
+ */
+void
+elem_put(Cell *x)
+{
+	struct elem *e = (struct elem *)x;
+	Value v;
+
+	if (e->dirty) {
+		v = value_get(x);
+		value_free(*e->val);
+		*e->val = v;
+	}
+	cell_free(x);
+	x->ctype = CFREE;
+	freeelems[nfreeelems++] = e;
+}
+
+/*
+ * make all the Elems free, the ones in use are not stored back
+ */
+void
+elem_reset(void)
+{
+	struct elem *e;
+	int i;
+
+	nfreeelems = 0;
+	for (i = 0; i < elemssize; i++) {
+		e = &elemblks[i / AELEMS][i % AELEMS];
+		if (iselem(&e->cell))
+			cell_free(&e->cell);
+		e->cell.ctype = CFREE;
+		freeelems[nfreeelems++] = e;
+	}
+}
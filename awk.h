@@ -34,7 +34,9 @@ THIS SOFTWARE.
 
 extern int	compile_time;	/* 1 if compiling, 0 if running */
 
-extern int	recsize;	/* size of current record, orig RECSIZE */
+#define	RECSIZE	(8 * 1024)	/* initial size and quantum of the buffers */
+extern int	recsize;	/* size of the buffer of $0 */
+extern size_t	reclen;		/* length of $0 as read */
 
 extern double *NR;
 extern double *NF;
@@ -55,28 +57,70 @@ enum ctype {
 	CCOPY,
 	CTRUE,
 	CFALSE,
+	CELEM,		/* stands for an array element */
 };
 
 
 /*
  * Cell:  all information about a variable or constant
+ *
+ * Names live in the symbol table, see cell_name().
  */
 typedef struct Cell {
-	enum ctype	 ctype;	/* Cell type */
-	char		*nval;	/* name, for variables only */
-	char		*sval;	/* string value */
-	double	 	 fval;	/* value as number */
-	unsigned int 	 tval;	/* type info */
+	uint8_t		 ctype;	/* Cell type, an enum ctype */
+	uint16_t	 tval;	/* type info */
 #define	NUM		(1 << 0)	/* number value is valid */
 #define	STR		(1 << 1)	/* string value is valid */
 #define	DONTFREE	(1 << 2)	/* string space is not freeable */
 #define	CON		(1 << 3)	/* this is a constant */
-	struct Cell	*cnext;	/* ptr to next if chained */
+#define	ARR		(1 << 4)	/* this is an array, sval is a map */
+#define	INLINE		(1 << 5)	/* sval is sbuf, implies DONTFREE */
+	int		 cnum;	/* field number, symtab slot or -1 */
+	double	 	 fval;	/* value as number */
+	char		*sval;	/* string value */
+#define	CELLSTR		16
+	char		 sbuf[CELLSTR];	/* short string values */
 } Cell;
 
 #define isstr(n)	((n)->tval & STR)
+#define isarr(n)	((n)->tval & ARR)
 #define isrec(n)	((n)->ctype == CREC)
 #define isfld(n)	((n)->ctype == CFLD)
+#define iselem(n)	((n)->ctype == CELEM)
+
+/*
+ * Value:  a scalar in 8 bytes, how array elements are stored
+ *
+ * A number is stored as a double, with NaNs made canonical so that the
+ * other NaNs can carry a string: up to 6 bytes inline, or a pointer to
+ * a reference counted string.  Strings from the input that look like
+ * numbers have tags of their own.
+ *
+ * Values are only read through an Elem: the evaluator works on Cells,
+ * and temporaries and fields stay Cells.
+ */
+typedef uint64_t Value;
+
+#define	VTAG(v)		((v) >> 48)
+#define	VBITS(v)	((v) & 0xffffffffffffULL)
+#define	VSHORT		0xfffcULL	/* up to 6 bytes inline */
+#define	VSHORTNUM	0xfffdULL
+#define	VSTR		0xfffeULL	/* reference counted string */
+#define	VSTRNUM		0xffffULL
+#define	VEMPTY		(VSHORTNUM << 48)	/* "" and 0 */
+#define	visnum(v)	(VTAG(v) < VSHORT)
+#define	visshort(v)	((VTAG(v) & ~1ULL) == VSHORT)
+#define	visstrnum(v)	(!visnum(v) && (VTAG(v) & 1))
+
+/*
+ * Elem:  Cell standing for an array element while an expression uses
+ * it.  It is stored back into the Value when released, if changed.
+ */
+struct elem {
+	Cell		 cell;
+	Value		*val;
+	int		 dirty;
+};
 
 
 
@@ -92,6 +136,7 @@ typedef struct Node {
 	struct	Node *nnext;
 	int	lineno;
 	int	nobj;
+	int	nargs;		/* number of narg[] */
 	Cell *(*proc)(struct Node **, int);
 	struct	Node *narg[1];	/* variable: actual size set by calling malloc */
 } Node;
@@ -99,8 +144,34 @@ typedef struct Node {
 extern Node	*rootnode;
 extern Node	*nullnode;
 
+/*
+ * Kernel: fused loop for a program made of a single rule of the form
+ *
+ *	[$k relop constant] { [s += $k;] [n++;] ... }
+ *
+ * Accumulators are kept in registers and written back at the end.
+ */
+#define	MAXKACC		8	/* max number of accumulators */
+#define	MAXKFIELD	64	/* max field index looked at */
+
+struct kernel {
+	Node	*krule;		/* the rule, for records we can't handle */
+	Node	*kbody;		/* body, if not made of accumulators only */
+	int	 kfield;	/* field of the filter, -1 if none */
+	int	 krelop;	/* relational operator of the filter */
+	double	 kconst;	/* constant of the filter */
+	int	 kmaxfield;	/* last field looked at */
+	int	 nacc;
+	struct {
+		Cell	*cell;
+		int	 field;	/* field to add, -1 for a counter */
+	} kacc[MAXKACC];
+};
+
 /* parser.y */
 extern	Node	*notnull(Node *);
+extern	const char *tokname(int);
+extern	Node	*makearr(Node *);
 extern	int	yyparse(void);
 extern	int	yylex(void);
 extern	int	input(void);
@@ -114,6 +185,9 @@ extern	int	pgetc(void);
 extern	char	*cursource(void);
 
 /* node.c */
+void		 nodeinit(int, Node *);
+int		 nodeargs(int);
+uint64_t	 nodelayout(void);
 Node		*op1(int, Node *);
 Node		*op2(int, Node *, Node *);
 Node		*op3(int, Node *, Node *, Node *);
@@ -125,18 +199,137 @@ Node		*cell2node(Cell *, int);
 Node		*record2node(void);
 Node		*node_link(Node *, Node *);
 
+/* opt.c */
+extern	int	nofields;
+extern	struct kernel	*kernel;
+extern	int	passthrough;
+extern	double	nrfirst;
+extern	double	nrlast;
+extern	int	nrcount;
+void		 opt_program(Node *);
+int		 prefilter_match(const char *, size_t);
+
+/* array.c */
+struct amap	*amap_alloc(void);
+Value		*amap_get(struct amap *, const char *, int);
+void		 amap_delete(struct amap *, const char *);
+void		 amap_clear(struct amap *);
+size_t		 amap_keys(struct amap *, char **);
+Cell		*elem_get(Value *);
+void		 elem_put(Cell *);
+void		 elem_reset(void);
+
+/* prof.c */
+extern	int	profiling;
+void		 prof_init(const char *, Node *, const char *);
+void		 prof_main(FILE *, Node *);
+Cell		*prof_call(Node **, int);
+Cell		*prof_pastat(Node **, int);
+
+/* phase.c */
+struct stats {
+	uint64_t	 records;	/* records read */
+	uint64_t	 bytes;		/* bytes read */
+	uint64_t	 fields;	/* fields split */
+	uint64_t	 atof;		/* strings parsed by fval_get() */
+	uint64_t	 isnum;		/* calls to is_number() */
+	uint64_t	 fmtnum;	/* numbers formatted by sval_get() */
+	uint64_t	 rebuilds;	/* $0 rebuilt from fields */
+	uint64_t	 temps;		/* cells from tcell_get() */
+};
+extern	struct stats	stats;
+
+enum phase {
+	PH_NONE = 0,
+	PH_PARSE,
+	PH_READ,
+	PH_SPLIT,
+	PH_EVAL,
+	PH_OUTPUT,
+	NPHASES
+};
+extern	int	phasing;
+void		 phase_init(int, int);
+int		 phase_enter(int);
+
+/* cache.c */
+int		 cache_load(const char *, const char *);
+void		 cache_save(void);
+
+/* multi.c */
+void		 multi_init(char **);
+int		 multi_run(FILE *);
+
+/* pipe.c */
+struct pfield {
+	size_t		 off;		/* of the \0 terminated text */
+	double		 fval;
+	int		 isnum;
+};
+extern	int	pipelining;
+int		 pipe_get(FILE *);
+void		 pipe_stop(void);
+
+/* par.c */
+int		 par_ok(Node *, FILE *);
+int		 par_run(FILE *, Node *, int);
+int		 par_keyed(FILE *, Node *, int, int);
+
+/* index.c */
+int		 index_build(const char *);
+int		 index_load(const char *, FILE *);
+void		 index_unload(void);
+int		 index_chunk(int, int, off_t *, double *);
+int		 index_find(double, off_t *, double *);
+
+/* uring.c */
+extern	int	uringing;
+ssize_t		 uring_read(int, void *, size_t);
+void		 uring_reset(void);
+
+/* serve.c */
+extern	int	serving;
+__dead void	 serve(const char *);
+__dead void	 serve_abort(void);
+
+/* kernel.c */
+void		 kernel_run(FILE *, struct kernel *);
+void		 pass_run(FILE *, Node *);
+
 /* symtab.c */
 void		 symtab_init(void);
 Cell		*symtab_set(const char *, const char *, double, unsigned int);
+Cell		*symtab_lookup(const char *);
+Cell		*symtab_slot(int);
+int		 symtab_nslots(void);
+const char	*cell_name(Cell *);
+void		 symtab_save(void);
+void		 symtab_restore(void);
+uint64_t	 hash(const void *, size_t);
 
 /* record.c */
+extern	int	maxrec;
 void		 record_init(void);
+void		 record_reset(void);
+void		 record_symtab(void);
+void		 record_sync(void);
+void		 record_set(const char *, size_t);
 int		 record_get(FILE *);
+int		 record_next(FILE *, char **, size_t *);
+void		 record_load(const char *, size_t);
+int		 record_skip(FILE *);
+void		 record_count(FILE *);
+void		 record_skipto(FILE *, double);
+void		 record_range(FILE *, off_t, off_t, double);
+void		 record_pass(char *, size_t);
+void		 record_flush(void);
 void		 record_cache(Cell *);
 void		 record_invalidate(Cell *);
 void		 field_add(int);
 Cell		*field_get(int);
+void		 field_load(char *, const struct pfield *, int);
 int		 is_number(const char *);
+int		 is_numval(const char *, double *);
 
 /* run.c */
 void		 xadjbuf(char **, int *, int, int, char **, const char *);
@@ -154,18 +347,64 @@ extern	Cell	*f_condexpr(Node **, int);
 extern	Cell	*f_if(Node **, int);
 extern	Cell	*f_print(Node **, int);
 extern	Cell	*f_null(Node **, int);
+extern	Cell	*f_array(Node **, int);
+extern	Cell	*f_intest(Node **, int);
+extern	Cell	*f_forin(Node **, int);
+extern	Cell	*f_delete(Node **, int);
+Cell		*tcell_get(void);
+void		 tcell_put(Cell *);
+void		 run_reset(void);
 void		 cell_free(Cell *);
 double		 fval_get(Cell *);
 double		 fval_set(Cell *, double);
+int		 fmtnum(char *, size_t, double);
 char		*sval_get(Cell *);
 char		*sval_set(Cell *, const char *);
+char		*sval_share(Cell *, Cell *);
+char		*sval_assign(Cell *, char *);
+char		*rstr_new(const char *);
+char		*rstr_const(const char *);
+char		*rstr_get(char *);
+char		*rstr_reuse(char *, size_t);
+void		 rstr_put(char *);
+Value		 value_get(Cell *);
+void		 value_load(Cell *, Value);
+void		 value_free(Value);
+
+/* arena.c */
+void		*arena_alloc(size_t);
+char		*arena_strdup(const char *);
+void		*tmp_alloc(size_t);
+void		 tmp_reset(void);
 
 /* xmalloc.c */
-void	*xmalloc(size_t);
-void	*xcalloc(size_t, size_t);
-void	*xrealloc(void *, size_t);
-void	*xreallocarray(void *, size_t, size_t);
-char	*xstrdup(const char *);
+
+/* allocations made from one call site, for -s */
+struct asite {
+	const char	*file;
+	int		 line;
+	const char	*fn;
+	uint64_t	 count;
+	uint64_t	 bytes;
+	struct asite	*next;
+};
+extern	struct asite	*asites;
+
+#define	ASITE(fn)	({						\
+	static struct asite __as = { __FILE__, __LINE__, fn };		\
+	&__as;								\
+})
+#define	xmalloc(s)		xmalloc_at(ASITE("xmalloc"), s)
+#define	xcalloc(n, s)		xcalloc_at(ASITE("xcalloc"), n, s)
+#define	xrealloc(p, s)		xrealloc_at(ASITE("xrealloc"), p, s)
+#define	xreallocarray(p, n, s)	xreallocarray_at(ASITE("xreallocarray"), p, n, s)
+#define	xstrdup(s)		xstrdup_at(ASITE("xstrdup"), s)
+
+void	*xmalloc_at(struct asite *, size_t);
+void	*xcalloc_at(struct asite *, size_t, size_t);
+void	*xrealloc_at(struct asite *, void *, size_t);
+void	*xreallocarray_at(struct asite *, void *, size_t, size_t);
+char	*xstrdup_at(struct asite *, const char *);
 int	 xasprintf(char **, const char *, ...)
                 __attribute__((__format__ (printf, 2, 3)))
                 __attribute__((__nonnull__ (2)));
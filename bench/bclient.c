@@ -0,0 +1,148 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * bclient: send jobs to a uawk -S server and time them.
+ *
+ *	bclient [-n jobs] [-o output] socket input
+ *
+ * Each job runs the program of the server on `input', writing to
+ * `output', /dev/null by default.  Prints the exit status of the last
+ * job, and the mean time of a job on the standard error.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define	SJOBMAGIC	0x75617731	/* as in serve.c */
+
+struct sjob {
+	uint32_t	 magic;
+};
+
+__dead void	 usage(void);
+int		 job(int, int, int);
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-n jobs] [-o output] socket input\n",
+	    getprogname());
+	exit(1);
+}
+
+int
+job(int s, int in, int out)
+{
+	union {
+		struct cmsghdr	 hdr;
+		char		 buf[CMSG_SPACE(2 * sizeof(int))];
+	} cmsgbuf;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	struct sjob j;
+	int fds[2], status;
+
+	j.magic = SJOBMAGIC;
+	fds[0] = in;
+	fds[1] = out;
+	memset(&msg, 0, sizeof(msg));
+	memset(&cmsgbuf, 0, sizeof(cmsgbuf));
+	iov.iov_base = &j;
+	iov.iov_len = sizeof(j);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = &cmsgbuf.buf;
+	msg.msg_controllen = sizeof(cmsgbuf.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	if (sendmsg(s, &msg, 0) != sizeof(j))
+		err(1, "sendmsg");
+	if (read(s, &status, sizeof(status)) != sizeof(status))
+		errx(1, "no reply from server");
+	return status;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct sockaddr_un sun;
+	struct timespec start, end;
+	const char *output = "/dev/null", *errstr;
+	int ch, i, in, out, s, status = 0, njobs = 1;
+
+	while ((ch = getopt(argc, argv, "n:o:")) != -1) {
+		switch (ch) {
+		case 'n':
+			njobs = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "jobs is %s: %s", errstr, optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 2)
+		usage();
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlcpy(sun.sun_path, argv[0], sizeof(sun.sun_path)) >=
+	    sizeof(sun.sun_path))
+		errx(1, "socket path too long: %s", argv[0]);
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	if (connect(s, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+		err(1, "connect %s", argv[0]);
+	if ((out = open(output, O_WRONLY | O_CREAT | O_APPEND, 0666)) == -1)
+		err(1, "%s", output);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < njobs; i++) {
+		if ((in = open(argv[1], O_RDONLY)) == -1)
+			err(1, "%s", argv[1]);
+		status = job(s, in, out);
+		close(in);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	fprintf(stderr, "%d jobs, %.1f us per job\n", njobs,
+	    ((end.tv_sec - start.tv_sec) * 1e9 +
+	    (end.tv_nsec - start.tv_nsec)) / njobs / 1e3);
+	printf("%d\n", status);
+	return 0;
+}
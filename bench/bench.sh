@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# Run every workload on every input with uawk and the other awks found
+# on the machine, and print one line per run:
+#
+#	workload input awk seconds records/s MB/s maxrss-KB
+#
+# An awk whose output differs from the one of uawk is marked with a `*'.
+# uawk is also run with each of the options of VARIANTS, as uawk-u for
+# -u, to compare its input paths.
+
+: ${UAWK:=../obj/uawk}
+: ${BTIME:=./btime}
+: ${DATADIR:=/tmp/uawk-bench}
+: ${SIZE:=1024}
+: ${AWKS:=mawk gawk nawk original-awk bwk-awk busybox}
+: ${WORKLOADS:=read split numeric print printf}
+: ${INPUTS:=wide narrow long short}
+: ${VARIANTS:=-u -uu}
+
+CURDIR=$(dirname "$0")
+OUT=${DATADIR}/out
+
+awks="$UAWK"
+for v in $VARIANTS; do
+	awks="$awks $UAWK:$v"
+done
+for a in $AWKS; do
+	command -v $a >/dev/null 2>&1 && awks="$awks $a"
+done
+
+printf "%-8s %-7s %-16s %8s %12s %8s %10s\n" \
+    workload input awk seconds records/s MB/s maxrss-KB
+for input in $INPUTS; do
+	data=${DATADIR}/${input}-${SIZE}.txt
+	set -- $(wc -lc < $data)
+	records=$1 bytes=$2
+	for w in $WORKLOADS; do
+		for a in $awks; do
+			case $a in
+			*:*)	name=$(basename ${a%%:*})${a#*:}
+				cmd="${a%%:*} ${a#*:}" ;;
+			busybox)
+				name=$a
+				cmd="busybox awk" ;;
+			*)	name=$(basename $a)
+				cmd=$a ;;
+			esac
+			set -- $($BTIME -o $OUT.$name $cmd -f $CURDIR/$w.awk \
+			    $data 2>&1 | tail -1)
+			[ $a = $UAWK ] || cmp -s $OUT.uawk $OUT.$name || \
+			    name="$name*"
+			printf "%-8s %-7s %-16s %8s %12.0f %8.1f %10s\n" \
+			    $w $input $name $1 $(echo $1 $records $bytes | \
+			    awk '{ t = $1; if (t == 0) t = 0.001;
+			    printf("%f %f", $2 / t, $3 / t / 1048576) }') $2
+		done
+		rm -f $OUT.*
+	done
+done
@@ -0,0 +1,96 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * btime: run a command and report how long it took and how much memory
+ * it used, for the benchmark scripts.
+ *
+ *	btime [-o output] command [arg ...]
+ *
+ * Prints "seconds maxrss-kilobytes" on the standard error.  The standard
+ * output of the command goes to output, /dev/null by default.
+ */
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+__dead void	 usage(void);
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-o output] command [arg ...]\n",
+	    getprogname());
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timespec start, end;
+	struct rusage ru;
+	const char *output = "/dev/null";
+	pid_t pid;
+	int ch, fd, status;
+
+	while ((ch = getopt(argc, argv, "+o:")) != -1) {
+		switch (ch) {
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc == 0)
+		usage();
+
+	if ((fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1)
+		err(1, "%s", output);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	switch (pid = fork()) {
+	case -1:
+		err(1, "fork");
+	case 0:
+		if (dup2(fd, STDOUT_FILENO) == -1)
+			err(1, "dup2");
+		execvp(argv[0], argv);
+		err(127, "%s", argv[0]);
+	}
+	if (wait4(pid, &status, 0, &ru) == -1)
+		err(1, "wait4");
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	fprintf(stderr, "%.3f %ld\n", (end.tv_sec - start.tv_sec) +
+	    (end.tv_nsec - start.tv_nsec) / 1e9, ru.ru_maxrss);
+
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	return 1;
+}
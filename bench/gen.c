@@ -0,0 +1,286 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * gen: write deterministic benchmark input to the standard output.
+ *
+ *	gen [-s seed] kind megabytes
+ *
+ * The same seed always gives the same bytes, so that runs on different
+ * machines or builds look at the same input.
+ */
+
+#include <err.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef nitems
+#define nitems(_a)	(sizeof((_a)) / sizeof((_a)[0]))
+#endif
+
+#define	OBUFSIZE	(256 * 1024)
+
+const char *words[] = {
+	"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+	"hotel", "india", "juliett", "kilo", "lima", "mike", "november",
+	"oscar", "papa", "quebec", "romeo", "sierra", "tango", "uniform",
+	"victor", "whiskey", "xray", "yankee", "zulu",
+};
+
+char		 obuf[OBUFSIZE];
+size_t		 olen;
+uint64_t	 written, limit;
+uint64_t	 seed = 0x2545f4914f6cdd1dULL;
+
+__dead void	 usage(void);
+uint64_t	 rnd(void);
+void		 flush(void);
+void		 put(const char *, size_t);
+void		 putstr(const char *);
+void		 putword(void);
+void		 putint(uint64_t);
+void		 putfloat(void);
+void		 gen_wide(void);
+void		 gen_narrow(void);
+void		 gen_long(void);
+void		 gen_short(void);
+void		 gen_prog(void);
+
+const struct {
+	const char	*name;
+	void		(*fn)(void);
+} kinds[] = {
+	{ "wide",	gen_wide },	/* 24 mixed fields, ~180 bytes */
+	{ "narrow",	gen_narrow },	/* 3 numeric fields, ~18 bytes */
+	{ "long",	gen_long },	/* 2K fields, ~13KB */
+	{ "short",	gen_short },	/* one field of 1 to 8 bytes */
+	{ "prog",	gen_prog },	/* a program of many rules */
+};
+
+__dead void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-s seed] wide | narrow | long | short | "
+	    "prog megabytes\n", getprogname());
+	exit(1);
+}
+
+/* xorshift64* */
+uint64_t
+rnd(void)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return seed * 0x2545f4914f6cdd1dULL;
+}
+
+void
+flush(void)
+{
+	if (fwrite(obuf, 1, olen, stdout) != olen)
+		err(1, "write");
+	olen = 0;
+}
+
+void
+put(const char *s, size_t len)
+{
+	if (olen + len > sizeof(obuf))
+		flush();
+	memcpy(obuf + olen, s, len);
+	olen += len;
+	written += len;
+}
+
+void
+putstr(const char *s)
+{
+	put(s, strlen(s));
+}
+
+void
+putword(void)
+{
+	putstr(words[rnd() % nitems(words)]);
+}
+
+void
+putint(uint64_t n)
+{
+	char buf[24], *p = buf + sizeof(buf);
+
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n != 0);
+	put(p, buf + sizeof(buf) - p);
+}
+
+void
+putfloat(void)
+{
+	uint64_t r = rnd();
+
+	putint((r >> 8) % 100000);
+	put(".", 1);
+	putint(r % 10);
+	putint((r >> 4) % 10);
+}
+
+void
+gen_wide(void)
+{
+	int i;
+
+	while (written < limit) {
+		for (i = 0; i < 24; i++) {
+			if (i > 0)
+				put(" ", 1);
+			switch (i % 3) {
+			case 0:
+				putword();
+				break;
+			case 1:
+				putint(rnd() % 1000000);
+				break;
+			case 2:
+				putfloat();
+				break;
+			}
+		}
+		put("\n", 1);
+	}
+}
+
+void
+gen_narrow(void)
+{
+	uint64_t nr = 0;
+
+	while (written < limit) {
+		putint(++nr);
+		put(" ", 1);
+		putint(rnd() % 1000);
+		put(" ", 1);
+		putfloat();
+		put("\n", 1);
+	}
+}
+
+void
+gen_long(void)
+{
+	int i;
+
+	while (written < limit) {
+		for (i = 0; i < 2048; i++) {
+			if (i > 0)
+				put(" ", 1);
+			if (i % 2)
+				putint(rnd() % 1000000);
+			else
+				putword();
+		}
+		put("\n", 1);
+	}
+}
+
+void
+gen_short(void)
+{
+	static const char alnum[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+	char buf[9];
+	uint64_t r;
+	int i, n;
+
+	while (written < limit) {
+		r = rnd();
+		n = 1 + r % 8;
+		for (i = 0; i < n; i++) {
+			r >>= 6;
+			buf[i] = alnum[r % (sizeof(alnum) - 1)];
+		}
+		buf[n] = '\n';
+		put(buf, n + 1);
+	}
+}
+
+/*
+ * rules of the form
+ *
+ *	$1 == "word123" { c12 += $2; n[$3]++ }
+ */
+void
+gen_prog(void)
+{
+	uint64_t r, nr = 0;
+
+	while (written < limit) {
+		r = rnd();
+		putstr("$1 == \"");
+		putword();
+		putint(nr++);
+		putstr("\" { c");
+		putint(r % 1000);
+		putstr(" += $2; n[$3]++ }\n");
+	}
+	putstr("END { print(c1, c2, c3) }\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *errstr;
+	size_t i;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "s:")) != -1) {
+		switch (ch) {
+		case 's':
+			seed = strtonum(optarg, 1, LLONG_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "seed is %s: %s", errstr, optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 2)
+		usage();
+
+	limit = strtonum(argv[1], 1, 1024 * 1024, &errstr);
+	if (errstr != NULL)
+		errx(1, "size is %s: %s", errstr, argv[1]);
+	limit *= 1024 * 1024;
+
+	for (i = 0; i < nitems(kinds); i++) {
+		if (strcmp(argv[0], kinds[i].name) == 0) {
+			kinds[i].fn();
+			flush();
+			return 0;
+		}
+	}
+	usage();
+}
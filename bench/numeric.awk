@@ -0,0 +1,2 @@
+{ s += $2 }
+END { printf("%.2f\n", s) }
@@ -0,0 +1 @@
+{ printf("%s %d %.2f\n", $1, $2, $3) }
@@ -0,0 +1,2 @@
+{ f = $20 }
+END { print(f) }
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# Time the startup of a program of ${PROGSIZE} megabytes of rules, on an
+# empty input: parsing it, with uawk and the other awks found on the
+# machine, and loading it from the program cache of uawk.
+
+: ${UAWK:=../obj/uawk}
+: ${BTIME:=./btime}
+: ${DATADIR:=/tmp/uawk-bench}
+: ${PROGSIZE:=1}
+: ${AWKS:=mawk gawk nawk original-awk bwk-awk busybox}
+
+prog=${DATADIR}/prog-${PROGSIZE}.awk
+cache=${DATADIR}/cache
+
+awks="$UAWK"
+for a in $AWKS; do
+	command -v $a >/dev/null 2>&1 && awks="$awks $a"
+done
+
+run() {
+	name=$1
+	shift
+	set -- $($BTIME "$@" -f $prog /dev/null 2>&1 | tail -1)
+	printf "%-20s %8s %10s\n" "$name" $1 $2
+}
+
+printf "%-20s %8s %10s\n" awk seconds maxrss-KB
+for a in $awks; do
+	if [ $a = busybox ]; then
+		run busybox busybox awk
+	else
+		run $(basename $a) $a
+	fi
+done
+rm -rf $cache
+mkdir -p $cache
+run "uawk -c (cold)" $UAWK -c $cache
+run "uawk -c (warm)" $UAWK -c $cache
@@ -0,0 +1,586 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Cache of parsed programs, enabled by -c dir.
+ *
+ * After a successful parse the tree is written to dir, in a file named
+ * after a hash of the program text and of the layout of the tree.  A
+ * later run of the same program maps that file and relocates it in
+ * place instead of parsing again.
+ *
+ * The image holds the program text, to tell hash collisions apart, the
+ * symbol table, since every Cell of the tree is in it, and the Nodes
+ * laid out as in memory with offsets instead of pointers.  A Cell is
+ * referred to by its slot.  The proc of a Node is found again from its
+ * nobj, and the optimizer runs on the loaded tree as on a parsed one.
+ *
+ * Every offset, slot and nobj of an image is checked before it is used:
+ * a damaged image is ignored and the program parsed again.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "awk.h"
+#include "ytab.h"
+
+#define	CACHEMAGIC	"uawkprg2"
+#define	CACHEALIGN	sizeof(uint64_t)
+#define	calign(n)	(((n) + CACHEALIGN - 1) & ~(CACHEALIGN - 1))
+
+struct cheader {
+	char		 magic[8];
+	uint64_t	 build;
+	uint64_t	 textlen;
+	uint64_t	 nslots;
+	uint64_t	 strsize;	/* names and string values */
+	uint64_t	 nodesize;
+	uint64_t	 root;		/* offset of rootnode */
+	uint64_t	 sum;		/* of the rest, see cache_sum() */
+	/* text, slots, strings, nodes */
+};
+
+struct cslot {
+	uint64_t	 name;		/* offset in strings */
+	uint64_t	 sval;		/* offset in strings, if not an array */
+	double		 fval;
+	uint16_t	 tval;
+	uint8_t		 ctype;
+};
+
+/* Node to image offset */
+struct cnode {
+	Node		*node;
+	uint64_t	 off;
+};
+
+char		*cachepath;	/* image of this program */
+char		*cachetext;	/* program text */
+size_t		 cachelen;
+struct cnode	*cnodes;
+size_t		 ncnodes, cnodessize;
+
+uint64_t	 cache_build(void);
+uint64_t	 cache_sum(const char *, size_t, const struct cslot *, size_t,
+		    const char *, size_t, const char *, size_t);
+int		 cache_text(const char *);
+size_t		 cnode_size(Node *);
+uint64_t	 cnode_off(Node *);
+void		 cnode_add(Node *, uint64_t *);
+int		 cache_check(struct cheader *, struct cslot *, const char *,
+		    char *);
+int		 cache_link(uint64_t, size_t, char *, const uint8_t *, size_t);
+int		 cache_names(struct cslot *, size_t, const char *);
+int		 cache_namecmp(const void *, const void *);
+void		 cache_relocate(char *, size_t);
+void		 cache_symtab(struct cslot *, size_t, const char *);
+
+/*
+ * identity of the image layout, changed with the grammar or the Nodes
+ */
+uint64_t
+cache_build(void)
+{
+	uint64_t v[3];
+
+	v[0] = nodelayout();
+	v[1] = sizeof(struct cheader);
+	v[2] = sizeof(struct cslot);
+	return hash(v, sizeof(v));
+}
+
+/*
+ * hash of the parts of an image, to tell a damaged one
+ */
+uint64_t
+cache_sum(const char *text, size_t textlen, const struct cslot *cs,
+    size_t nslots, const char *strs, size_t strsize, const char *nodes,
+    size_t nodesize)
+{
+	uint64_t v[4];
+
+	v[0] = hash(text, textlen);
+	v[1] = hash(cs, nslots * sizeof(*cs));
+	v[2] = hash(strs, strsize);
+	v[3] = hash(nodes, nodesize);
+	return hash(v, sizeof(v));
+}
+
+/*
+ * gather the program text, from prog or the -f files
+ */
+int
+cache_text(const char *prog)
+{
+	extern char *pfile[];
+	extern int npfile;
+	char buf[8192];
+	size_t n;
+	FILE *fp;
+	int i;
+
+	if (prog != NULL) {
+		cachetext = xstrdup(prog);
+		cachelen = strlen(prog);
+		return 1;
+	}
+	for (i = 0; i < npfile; i++) {
+		if (strcmp(pfile[i], "-") == 0)
+			return 0;
+		if ((fp = fopen(pfile[i], "r")) == NULL)
+			return 0;
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+			cachetext = xrealloc(cachetext, cachelen + n + 1);
+			memcpy(cachetext + cachelen, buf, n);
+			cachelen += n;
+		}
+		fclose(fp);
+		/* files are separated, as by pgetc() */
+		cachetext = xrealloc(cachetext, cachelen + 1);
+		cachetext[cachelen++] = '\0';
+	}
+	return cachetext != NULL;
+}
+
+/*
+ * load the program from the cache in `dir', returns 1 on success
+ *
+ * on failure cache_save() can be called once the program is parsed.
+ */
+int
+cache_load(const char *dir, const char *prog)
+{
+	struct cheader *h;
+	struct cslot *cs;
+	struct stat st;
+	uint64_t build, key;
+	char *img, *text, *strs, *nodes;
+	size_t off;
+	int fd;
+
+	if (!cache_text(prog))
+		return 0;
+	build = cache_build();
+	key = hash(cachetext, cachelen) ^ build;
+	xasprintf(&cachepath, "%s/%016llx.uawkc", dir, (unsigned long long)key);
+
+	if ((fd = open(cachepath, O_RDONLY)) == -1)
+		return 0;
+	if (fstat(fd, &st) == -1 || st.st_size < sizeof(*h)) {
+		close(fd);
+		return 0;
+	}
+	img = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+	    fd, 0);
+	close(fd);
+	if (img == MAP_FAILED)
+		return 0;
+
+	h = (struct cheader *)img;
+	if (memcmp(h->magic, CACHEMAGIC, sizeof(h->magic)) != 0 ||
+	    h->build != build || h->textlen != cachelen ||
+	    h->nslots > st.st_size / sizeof(*cs) ||
+	    h->strsize > st.st_size || h->nodesize > st.st_size)
+		goto bad;
+	off = sizeof(*h);
+	text = img + off;
+	off += calign(h->textlen);
+	cs = (struct cslot *)(img + off);
+	off += h->nslots * sizeof(*cs);
+	strs = img + off;
+	off += calign(h->strsize);
+	nodes = img + off;
+	off += h->nodesize;
+	if (off != st.st_size || memcmp(text, cachetext, cachelen) != 0 ||
+	    h->sum != cache_sum(text, h->textlen, cs, h->nslots, strs,
+	    h->strsize, nodes, h->nodesize) ||
+	    !cache_check(h, cs, strs, nodes))
+		goto bad;
+	cache_symtab(cs, h->nslots, strs);
+	cache_relocate(nodes, h->nodesize);
+	rootnode = (Node *)(nodes + h->root);
+	   DPRINTF("loaded program from %s\n", cachepath);
+	return 1;
+
+  bad:
+	   DPRINTF("ignoring the cache %s\n", cachepath);
+	munmap(img, st.st_size);
+	return 0;
+}
+
+/*
+ * can the slots and the Nodes of an image be used as they are?
+ */
+int
+cache_check(struct cheader *h, struct cslot *cs, const char *strs,
+    char *nodes)
+{
+	uint8_t *start;		/* 1 for the offsets of the Nodes */
+	size_t i, off, size = h->nodesize;
+	Node *x;
+	int j, ok = 0;
+
+	if (h->strsize == 0 || strs[h->strsize - 1] != '\0')
+		return 0;
+	for (i = 0; i < h->nslots; i++) {
+		if (cs[i].name >= h->strsize ||
+		    (!isarr(&cs[i]) && cs[i].sval >= h->strsize) ||
+		    (cs[i].tval & ~(NUM|STR|DONTFREE|CON|ARR|INLINE)) != 0 ||
+		    (cs[i].tval & (NUM|STR|ARR)) == 0 ||
+		    (cs[i].ctype != CUNK && cs[i].ctype != CVAR &&
+		    cs[i].ctype != CCON))
+			return 0;
+	}
+	if (!cache_names(cs, h->nslots, strs))
+		return 0;
+
+	start = xcalloc(size / CACHEALIGN + 1, 1);
+	for (off = 0; off < size; off += cnode_size(x)) {
+		x = (Node *)(nodes + off);
+		if (size - off < offsetof(Node, narg) + sizeof(Node *))
+			goto done;
+		if (x->ntype == NVALUE) {
+			if (x->nargs != 1 || x->nobj != 0 ||
+			    (uintptr_t)x->narg[0] >= h->nslots)
+				goto done;
+		} else if ((x->ntype != NSTAT && x->ntype != NEXPR) ||
+		    x->nargs != nodeargs(x->nobj))
+			goto done;
+		if (size - off < cnode_size(x))
+			goto done;
+		start[off / CACHEALIGN] = 1;
+	}
+	if (off != size || h->root >= size || h->root % CACHEALIGN != 0 ||
+	    !start[h->root / CACHEALIGN] ||
+	    ((Node *)(nodes + h->root))->nobj != PROGRAM)
+		goto done;
+	for (off = 0; off < size; off += cnode_size(x)) {
+		x = (Node *)(nodes + off);
+		if (!cache_link((uintptr_t)x->nnext, off, nodes, start, size))
+			goto done;
+		if (x->ntype == NVALUE)
+			continue;
+		for (j = 0; j < x->nargs; j++) {
+			if (!cache_link((uintptr_t)x->narg[j], off, nodes, start,
+			    size))
+				goto done;
+		}
+	}
+	ok = 1;
+  done:
+	free(start);
+	return ok;
+}
+
+/*
+ * is link, an offset plus one or 0 for NULL, the one of a Node that
+ * the Node at `from' can lead to?
+ */
+int
+cache_link(uint64_t link, size_t from, char *nodes, const uint8_t *start,
+    size_t size)
+{
+	Node *y;
+
+	if (link == 0)
+		return 1;
+	link--;
+	if (link >= size || link % CACHEALIGN != 0 || !start[link / CACHEALIGN])
+		return 0;
+	/* no loops: cnode_add() puts Nodes after the ones leading to them */
+	y = (Node *)(nodes + link);
+	return link > from || (y->ntype == NVALUE && y->nnext == NULL);
+}
+
+/*
+ * do the slots start with the symbols made before parsing, followed
+ * by new and distinct ones?
+ */
+int
+cache_names(struct cslot *cs, size_t nslots, const char *strs)
+{
+	const char *name, **names;
+	size_t i, n = symtab_nslots();
+	int ok = 1;
+
+	if (nslots < n)
+		return 0;
+	for (i = 0; i < n; i++) {
+		name = cell_name(symtab_slot(i));
+		if (name == NULL || strcmp(name, strs + cs[i].name) != 0)
+			return 0;
+	}
+	if (nslots == n)
+		return 1;
+	names = xreallocarray(NULL, nslots - n, sizeof(*names));
+	for (i = n; i < nslots; i++) {
+		names[i - n] = strs + cs[i].name;
+		if (symtab_lookup(names[i - n]) != NULL)
+			ok = 0;
+	}
+	qsort(names, nslots - n, sizeof(*names), cache_namecmp);
+	for (i = 1; ok && i < nslots - n; i++) {
+		if (strcmp(names[i - 1], names[i]) == 0)
+			ok = 0;
+	}
+	free(names);
+	return ok;
+}
+
+int
+cache_namecmp(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/*
+ * make the symbol table what it was after parsing, see cache_names()
+ */
+void
+cache_symtab(struct cslot *cs, size_t nslots, const char *strs)
+{
+	size_t i, n = symtab_nslots();
+	Cell *p;
+
+	for (i = 0; i < nslots; i++) {
+		if (i >= n) {
+			p = symtab_set(strs + cs[i].name, isarr(&cs[i]) ?
+			    "" : strs + cs[i].sval, cs[i].fval,
+			    cs[i].tval & ~ARR);
+			if (p->cnum != i)
+				FATAL("cached symbol %s out of place",
+				    strs + cs[i].name);
+		} else
+			p = symtab_slot(i);
+		p->ctype = cs[i].ctype;
+		if (isarr(&cs[i]) && !isarr(p)) {
+			cell_free(p);
+			p->sval = (char *)amap_alloc();
+			p->tval = ARR;
+		}
+	}
+}
+
+/*
+ * turn the offsets of the Nodes in nodes[0..size-1] back into pointers
+ */
+void
+cache_relocate(char *nodes, size_t size)
+{
+	Node *x;
+	size_t off;
+	int i;
+
+	for (off = 0; off < size; off += cnode_size(x)) {
+		x = (Node *)(nodes + off);
+		if (x->nnext != NULL)
+			x->nnext = (Node *)(nodes + (uintptr_t)x->nnext - 1);
+		if (x->ntype == NVALUE) {
+			x->narg[0] = (Node *)symtab_slot((uintptr_t)x->narg[0]);
+			continue;
+		}
+		nodeinit(x->nobj, x);
+		for (i = 0; i < x->nargs; i++) {
+			if (x->narg[i] != NULL)
+				x->narg[i] = (Node *)(nodes +
+				    (uintptr_t)x->narg[i] - 1);
+		}
+	}
+}
+
+size_t
+cnode_size(Node *x)
+{
+	return calign(offsetof(Node, narg) + x->nargs * sizeof(Node *));
+}
+
+/*
+ * image offset of Node x, once it has been added
+ */
+uint64_t
+cnode_off(Node *x)
+{
+	uint64_t h;
+
+	for (h = hash(&x, sizeof(x)); ; h++) {
+		if (cnodes[h & (cnodessize - 1)].node == x)
+			return cnodes[h & (cnodessize - 1)].off;
+	}
+}
+
+/*
+ * give offsets to x, the Nodes it leads to and the ones following it
+ */
+void
+cnode_add(Node *x, uint64_t *size)
+{
+	struct cnode *ocnodes;
+	size_t i, osize;
+	uint64_t h;
+	int j;
+
+	for (; x != NULL; x = x->nnext) {
+		if (2 * (ncnodes + 1) > cnodessize) {
+			ocnodes = cnodes;
+			osize = cnodessize;
+			cnodessize = osize ? 2 * osize : 256;
+			cnodes = xcalloc(cnodessize, sizeof(*cnodes));
+			ncnodes = 0;
+			for (i = 0; i < osize; i++) {
+				if (ocnodes[i].node == NULL)
+					continue;
+				h = hash(&ocnodes[i].node, sizeof(Node *));
+				while (cnodes[h & (cnodessize - 1)].node != NULL)
+					h++;
+				cnodes[h & (cnodessize - 1)] = ocnodes[i];
+				ncnodes++;
+			}
+			free(ocnodes);
+		}
+		for (h = hash(&x, sizeof(x)); ; h++) {
+			if (cnodes[h & (cnodessize - 1)].node == x)
+				return;		/* shared, as nullnode */
+			if (cnodes[h & (cnodessize - 1)].node == NULL)
+				break;
+		}
+		cnodes[h & (cnodessize - 1)].node = x;
+		cnodes[h & (cnodessize - 1)].off = *size;
+		ncnodes++;
+		*size += cnode_size(x);
+		if (x->ntype == NVALUE)
+			continue;
+		for (j = 0; j < x->nargs; j++)
+			cnode_add(x->narg[j], size);
+	}
+}
+
+/*
+ * write the image of the program just parsed
+ */
+void
+cache_save(void)
+{
+	struct cheader h;
+	struct cslot *cs;
+	const char *s;
+	char *strs = NULL, *nodes, *tmp;
+	size_t i, n, len, strsize = 0;
+	uint64_t nodesize = 0;
+	Node *x, *y;
+	Cell *p;
+	FILE *fp;
+	int fd, j;
+
+	if (cachepath == NULL || rootnode == NULL)
+		return;
+
+	n = symtab_nslots();
+	cs = xcalloc(n, sizeof(*cs));
+	for (i = 0; i < n; i++) {
+		p = symtab_slot(i);
+		cs[i].fval = p->fval;
+		cs[i].tval = p->tval;
+		cs[i].ctype = p->ctype;
+		for (j = 0; j < 2; j++) {
+			if (j == 0)
+				s = cell_name(p);
+			else if (isarr(p))
+				break;
+			else
+				s = p->sval ? p->sval : "";
+			len = strlen(s) + 1;
+			strs = xrealloc(strs, strsize + len);
+			memcpy(strs + strsize, s, len);
+			if (j == 0)
+				cs[i].name = strsize;
+			else
+				cs[i].sval = strsize;
+			strsize += len;
+		}
+	}
+
+	cnode_add(rootnode, &nodesize);
+	nodes = xcalloc(1, nodesize);
+	for (i = 0; i < cnodessize; i++) {
+		if ((x = cnodes[i].node) == NULL)
+			continue;
+		y = (Node *)(nodes + cnodes[i].off);
+		memcpy(y, x, offsetof(Node, narg));
+		y->proc = NULL;
+		if (x->nnext != NULL)
+			y->nnext = (Node *)(uintptr_t)(cnode_off(x->nnext) + 1);
+		if (x->ntype == NVALUE) {
+			y->narg[0] = (Node *)(uintptr_t)((Cell *)x->narg[0])->cnum;
+			continue;
+		}
+		for (j = 0; j < x->nargs; j++) {
+			if (x->narg[j] != NULL)
+				y->narg[j] = (Node *)(uintptr_t)
+				    (cnode_off(x->narg[j]) + 1);
+		}
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHEMAGIC, sizeof(h.magic));
+	h.build = cache_build();
+	h.textlen = cachelen;
+	h.nslots = n;
+	h.strsize = strsize;
+	h.nodesize = nodesize;
+	h.root = cnode_off(rootnode);
+	h.sum = cache_sum(cachetext, cachelen, cs, n, strs, strsize, nodes,
+	    nodesize);
+
+	/* written aside then renamed, for concurrent runs */
+	xasprintf(&tmp, "%s.XXXXXXXXXX", cachepath);
+	if ((fd = mkstemp(tmp)) == -1 || (fp = fdopen(fd, "w")) == NULL) {
+		warn("can't write cache %s", tmp);
+		goto done;
+	}
+	fwrite(&h, sizeof(h), 1, fp);
+	fwrite(cachetext, cachelen, 1, fp);
+	for (len = cachelen; len != calign(cachelen); len++)
+		putc('\0', fp);
+	fwrite(cs, sizeof(*cs), n, fp);
+	fwrite(strs, strsize, 1, fp);
+	for (len = strsize; len != calign(strsize); len++)
+		putc('\0', fp);
+	fwrite(nodes, nodesize, 1, fp);
+	if (fclose(fp) == EOF || rename(tmp, cachepath) == -1) {
+		warn("can't write cache %s", cachepath);
+		unlink(tmp);
+	}
+  done:
+	free(tmp);
+	free(cs);
+	free(strs);
+	free(nodes);
+	free(cnodes);
+	cnodes = NULL;
+	ncnodes = cnodessize = 0;
+}
@@ -0,0 +1,250 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Record index of an input file, written by --build-index.
+ *
+ * The index of `file' is kept aside in `file.uidx'.  It cuts the file
+ * in blocks of INDEXSTEP records and holds the offset of the first
+ * record and the number of records of each block, so that the records
+ * from any NR can be found without reading those before them.
+ *
+ * It is only used while the size and the modification time of the
+ * file are the ones it was built for.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "awk.h"
+
+#define	INDEXMAGIC	"uawkidx1"
+#define	INDEXSTEP	1024		/* records per block */
+
+struct iheader {
+	char		 magic[8];
+	uint64_t	 step;		/* records per block */
+	uint64_t	 size;		/* of the file */
+	int64_t		 mtime;
+	int64_t		 mtimensec;
+	uint64_t	 nblocks;
+	uint64_t	 nrecords;
+	/* nblocks offsets, nblocks counts */
+};
+
+struct iheader	*idx;		/* of the input, NULL if none */
+uint64_t	*idxoff;	/* offset of the first record of each block */
+uint32_t	*idxcount;	/* number of records of each block */
+
+/*
+ * write the index of `file', returns the exit status
+ */
+int
+index_build(const char *file)
+{
+	struct iheader h;
+	struct stat st;
+	uint64_t *off = NULL;
+	uint32_t *count = NULL;
+	size_t nblocks = 0, blockssize = 0;
+	off_t pos = 0, start;
+	char buf[64 * 1024], *p, *nl, *path, *tmp;
+	ssize_t r;
+	FILE *fp;
+	mode_t mask;
+	int fd, last = '\n';
+
+	if ((fd = open(file, O_RDONLY)) == -1)
+		err(1, "can't open file %s", file);
+	if (fstat(fd, &st) == -1)
+		err(1, "can't stat %s", file);
+	if (!S_ISREG(st.st_mode))
+		errx(1, "%s is not a regular file", file);
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + r; p = nl + 1) {
+			if (last == '\n') {
+				/* p starts a record */
+				start = pos + (p - buf);
+				if (nblocks == 0 || count[nblocks - 1] == INDEXSTEP) {
+					if (nblocks == blockssize) {
+						blockssize = blockssize * 2 + 64;
+						off = xreallocarray(off, blockssize,
+						    sizeof(*off));
+						count = xreallocarray(count,
+						    blockssize, sizeof(*count));
+					}
+					off[nblocks] = start;
+					count[nblocks++] = 0;
+				}
+				count[nblocks - 1]++;
+			}
+			if ((nl = memchr(p, '\n', buf + r - p)) == NULL) {
+				last = 0;
+				break;
+			}
+			last = '\n';
+		}
+		pos += r;
+	}
+	if (r == -1)
+		err(1, "read error on %s", file);
+	if (pos != st.st_size)
+		errx(1, "%s changed while indexed", file);
+	close(fd);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, INDEXMAGIC, sizeof(h.magic));
+	h.step = INDEXSTEP;
+	h.size = st.st_size;
+	h.mtime = st.st_mtim.tv_sec;
+	h.mtimensec = st.st_mtim.tv_nsec;
+	h.nblocks = nblocks;
+	h.nrecords = nblocks > 0 ?
+	    (nblocks - 1) * INDEXSTEP + count[nblocks - 1] : 0;
+
+	/* written aside then renamed, for concurrent runs */
+	xasprintf(&path, "%s.uidx", file);
+	xasprintf(&tmp, "%s.XXXXXXXXXX", path);
+	if ((fd = mkstemp(tmp)) == -1 || (fp = fdopen(fd, "w")) == NULL)
+		err(1, "can't write index %s", tmp);
+	/* readable as a file created by open(2) would be */
+	mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
+	fwrite(&h, sizeof(h), 1, fp);
+	fwrite(off, sizeof(*off), nblocks, fp);
+	fwrite(count, sizeof(*count), nblocks, fp);
+	if (fclose(fp) == EOF || rename(tmp, path) == -1) {
+		unlink(tmp);
+		err(1, "can't write index %s", path);
+	}
+	   DPRINTF("index %s: %zu blocks, %llu records\n", path, nblocks,
+	       (unsigned long long)h.nrecords);
+	free(tmp);
+	free(path);
+	free(off);
+	free(count);
+	return 0;
+}
+
+/*
+ * use the index of `file', opened as `inf', if there is an up to date
+ * one, returns 1 if so
+ */
+int
+index_load(const char *file, FILE *inf)
+{
+	struct iheader *h;
+	struct stat st, ist;
+	char *path;
+	void *img;
+	int fd;
+
+	index_unload();
+	if (fstat(fileno(inf), &st) == -1 || !S_ISREG(st.st_mode))
+		return 0;
+	xasprintf(&path, "%s.uidx", file);
+	fd = open(path, O_RDONLY);
+	free(path);
+	if (fd == -1)
+		return 0;
+	if (fstat(fd, &ist) == -1 || ist.st_size < sizeof(*h)) {
+		close(fd);
+		return 0;
+	}
+	img = mmap(NULL, ist.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (img == MAP_FAILED)
+		return 0;
+	h = img;
+	if (memcmp(h->magic, INDEXMAGIC, sizeof(h->magic)) != 0 ||
+	    h->step == 0 || h->nblocks > ist.st_size ||
+	    ist.st_size != sizeof(*h) + h->nblocks *
+	    (sizeof(*idxoff) + sizeof(*idxcount))) {
+		munmap(img, ist.st_size);
+		return 0;
+	}
+	if (h->size != st.st_size || h->mtime != st.st_mtim.tv_sec ||
+	    h->mtimensec != st.st_mtim.tv_nsec) {
+		   DPRINTF("index of %s is stale\n", file);
+		munmap(img, ist.st_size);
+		return 0;
+	}
+	idx = h;
+	idxoff = (uint64_t *)(h + 1);
+	idxcount = (uint32_t *)(idxoff + h->nblocks);
+	   DPRINTF("index of %s: %llu blocks\n", file,
+	       (unsigned long long)h->nblocks);
+	return 1;
+}
+
+void
+index_unload(void)
+{
+	if (idx == NULL)
+		return;
+	munmap(idx, sizeof(*idx) + idx->nblocks *
+	    (sizeof(*idxoff) + sizeof(*idxcount)));
+	idx = NULL;
+}
+
+/*
+ * start of the i-th of n parts of the input holding as many records,
+ * and the number of records before it
+ */
+int
+index_chunk(int i, int n, off_t *offp, double *nrp)
+{
+	uint64_t b, j;
+	double nr = 0;
+
+	if (idx == NULL)
+		return 0;
+	b = idx->nblocks * i / n;
+	for (j = 0; j < b; j++)
+		nr += idxcount[j];
+	*offp = b < idx->nblocks ? idxoff[b] : idx->size;
+	*nrp = nr;
+	return 1;
+}
+
+/*
+ * start of the block holding record nr+1, and the number of records
+ * before it
+ */
+int
+index_find(double nr, off_t *offp, double *nrp)
+{
+	uint64_t b;
+	double n = 0;
+
+	if (idx == NULL || idx->nblocks == 0)
+		return 0;
+	for (b = 0; b < idx->nblocks - 1 && n + idxcount[b] <= nr; b++)
+		n += idxcount[b];
+	*offp = idxoff[b];
+	*nrp = n;
+	return 1;
+}
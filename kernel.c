@@ -0,0 +1,231 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Fused loops for the idioms recognised by opt_kernel().
+ *
+ * Records are looked at in the input buffer, split only up to the
+ * last field needed, and numbers are converted in place.  A record
+ * whose filter field isn't a number, or which matches a filter with
+ * an arbitrary body, is handed over to the interpreter.  The records
+ * matching `pattern { print($0) }' are written from the input buffer.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "awk.h"
+#include "ytab.h"
+
+#define	issep(c)	((c) == ' ' || (c) == '\t' || (c) == '\n')
+#define	istrue(n)	((n)->ctype == CTRUE)
+
+void		 kernel_split(char *, size_t, int, char **, char **);
+double		 kernel_atof(char *, char *);
+int		 kernel_test(struct kernel *, char *, char *);
+void		 kernel_flush(struct kernel *, double *);
+void		 kernel_reload(struct kernel *, double *);
+
+void
+kernel_run(FILE *infile, struct kernel *k)
+{
+	extern Cell *nrloc;
+	char *fs[MAXKFIELD+1], *fe[MAXKFIELD+1];
+	double acc[MAXKACC], nr, nr0;
+	char *r;
+	size_t len;
+	Cell *x;
+	int i, f, m, touched = 0;
+
+	nr = nr0 = fval_get(nrloc);
+	kernel_reload(k, acc);
+	while ((nrlast == 0 || nr < nrlast) &&
+	    record_next(infile, &r, &len) > 0) {
+		nr++;
+		kernel_split(r, len, k->kmaxfield, fs, fe);
+		m = 1;
+		if (k->kfield != -1) {
+			f = k->kfield;
+			if ((m = kernel_test(k, fs[f], fe[f])) == 0)
+				continue;
+		}
+		if (m == 1 && passthrough && memchr(r, '\0', len) == NULL) {
+			record_pass(r, len);
+			continue;
+		}
+		if (m == -1 || k->kbody != NULL) {
+			/* hand the record over to the interpreter */
+			record_flush();
+			if (touched)
+				kernel_flush(k, acc);
+			fval_set(nrloc, nr - 1);
+			record_load(r, len);
+			x = execute(m == -1 ? k->krule : k->kbody);
+			tcell_put(x);
+			kernel_reload(k, acc);
+			continue;
+		}
+		for (i = 0; i < k->nacc; i++) {
+			f = k->kacc[i].field;
+			if (f == -1)
+				acc[i] += 1;
+			else
+				acc[i] += kernel_atof(fs[f], fe[f]);
+		}
+		touched = 1;
+	}
+	record_flush();
+	if (nr != nr0)
+		fval_set(nrloc, nr);
+	if (touched)
+		kernel_flush(k, acc);
+}
+
+/*
+ * run the rule `pattern { print($0) }', see opt_program()
+ *
+ * a matching record is written from the input buffer unless the
+ * pattern changed it, or print($0) would stop at a \0 in it.
+ */
+void
+pass_run(FILE *infile, Node *rule)
+{
+	extern char *record;
+	extern int recdirty;
+	char *r;
+	size_t len;
+	Cell *x;
+	int m;
+
+	while ((nrlast == 0 || *NR < nrlast) &&
+	    record_next(infile, &r, &len) > 0) {
+		record_load(r, len);
+		if (!prefilter_match(r, len))
+			continue;
+		m = 1;
+		if (rule->narg[0] != NULL) {
+			x = execute(rule->narg[0]);
+			m = istrue(x);
+			tcell_put(x);
+		}
+		if (!m)
+			continue;
+		if (!recdirty && memchr(r, '\0', len) == NULL) {
+			record_pass(r, len);
+			continue;
+		}
+		record_flush();
+		x = execute(rule->narg[1]);
+		tcell_put(x);
+	}
+	record_flush();
+}
+
+/*
+ * locate fields 0..n of record r, as in field_from_record()
+ *
+ * fields past NF are empty strings.
+ */
+void
+kernel_split(char *r, size_t len, int n, char **fs, char **fe)
+{
+	char *p = r;
+	int i;
+
+	fs[0] = r;
+	fe[0] = r + len;
+	for (i = 1; i <= n; i++) {
+		while (issep(*p))
+			p++;
+		fs[i] = p;
+		while (*p != '\0' && !issep(*p))
+			p++;
+		fe[i] = p;
+	}
+}
+
+/*
+ * numeric value of the string s..e, as fval_get() would compute it
+ */
+double
+kernel_atof(char *s, char *e)
+{
+	double v;
+	char c;
+
+	c = *e;
+	*e = '\0';
+	v = atof(s);
+	*e = c;
+	return v;
+}
+
+/*
+ * evaluate the filter on field s..e as f_relop() would
+ *
+ * return -1 if the field is not a number and a string comparison
+ * is needed.
+ */
+int
+kernel_test(struct kernel *k, char *s, char *e)
+{
+	double j;
+	char c;
+	int i;
+
+	c = *e;
+	*e = '\0';
+	if (!is_number(s)) {
+		*e = c;
+		return -1;
+	}
+	j = atof(s) - k->kconst;
+	*e = c;
+	i = j<0? -1: (j>0? 1: 0);
+	switch (k->krelop) {
+	case LT:	return i < 0;
+	case LE:	return i <= 0;
+	case NE:	return i != 0;
+	case EQ:	return i == 0;
+	case GE:	return i >= 0;
+	case GT:	return i > 0;
+	}
+	return -1;
+}
+
+/*
+ * write accumulators back to their variables
+ */
+void
+kernel_flush(struct kernel *k, double *acc)
+{
+	int i;
+
+	for (i = 0; i < k->nacc; i++)
+		fval_set(k->kacc[i].cell, acc[i]);
+}
+
+void
+kernel_reload(struct kernel *k, double *acc)
+{
+	int i;
+
+	for (i = 0; i < k->nacc; i++)
+		acc[i] = fval_get(k->kacc[i].cell);
+}
@@ -24,6 +24,8 @@ THIS SOFTWARE.
 ****************************************************************/
 
 #include <err.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <locale.h>
 #include <stdlib.h>
@@ -35,7 +37,15 @@ THIS SOFTWARE.
 extern	char	*__progname;
 
 int	debug	= 0;
+char	*proffile = NULL;	/* -p */
+char	*cachedir = NULL;	/* -c */
+char	*servepath = NULL;	/* -S */
+int	pmcflag = 0;		/* -P */
+int	statsflag = 0;		/* -s */
+int	njobs = 1;		/* -j */
+int	keyfield = -1;		/* -k */
 FILE	*infile	= NULL;
+extern	FILE	*outfile;
 extern	FILE	*yyin;	/* lex input file */
 char	*lexprog;	/* points to program argument if it exists */
 extern	int errorflag;	/* non-zero if any syntax errors; set by yyerror */
@@ -44,6 +54,8 @@ int	compile_time = 2;	/* for error printing: */
 
 #define	MAX_PFILE	20	/* max number of program files */
 char	*pfile[MAX_PFILE];	/* program filenames */
+char	*pout[MAX_PFILE];	/* their outputs, for -o */
+int	multi = 0;		/* 1 if every -f is a program, see -o */
 int	npfile = 0;		/* number of filenames */
 int	curpfile = 0;		/* current filename */
 
@@ -51,27 +63,38 @@ void		 fpecatch(int);
 
 __dead void usage(void)
 {
-	fprintf(stderr, "usage: %s [-d] [prog | -f progfile]\tfile ...\n",
-	    getprogname());
+	fprintf(stderr, "usage: %s [-dPstu] [-c cachedir] [-j jobs [-k field]] "
+	    "[-m maxrecord]\n"
+	    "            [-p profile] [prog | -f progfile] file ...\n"
+	    "       %s [-dPstu] [-c cachedir] [-m maxrecord] -S socket\n"
+	    "            [prog | -f progfile]\n"
+	    "       %s [-dPs] [-m maxrecord] -f progfile -o output "
+	    "[-f progfile ...] file\n"
+	    "       %s --build-index file\n",
+	    getprogname(), getprogname(), getprogname(), getprogname());
 	exit(1);
 }
 
 int main(int argc, char *argv[])
 {
-	char *file;
+	char *file, *prog = NULL;
+	const char *errstr;
 	int ch;
 
 	setlocale(LC_ALL, "");
 	setlocale(LC_NUMERIC, "C"); /* for parsing cmdline & prog */
 
-	if (pledge("stdio rpath wpath cpath proc exec", NULL) == -1) {
-		fprintf(stderr, "%s: pledge: incorrect arguments\n",
-		    getprogname());
-		exit(1);
+	if (argc == 3 && strcmp(argv[1], "--build-index") == 0) {
+		if (pledge("stdio rpath wpath cpath", NULL) == -1)
+			err(1, "pledge");
+		return index_build(argv[2]);
 	}
 
-	while ((ch = getopt(argc, argv, "f:d")) != -1) {
+	while ((ch = getopt(argc, argv, "c:f:dj:k:m:Po:p:S:stu")) != -1) {
 		switch (ch) {
+		case 'c':
+			cachedir = optarg;
+			break;
 		case 'f':
 			if (npfile >= MAX_PFILE - 1)
 				errx(1, "too many -f options");
@@ -80,6 +103,45 @@ int main(int argc, char *argv[])
 		case 'd':
 			debug++;
 			break;
+		case 'j':
+			njobs = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "number of jobs is %s: %s", errstr, optarg);
+			break;
+		case 'k':
+			keyfield = strtonum(optarg, 0, INT_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "key field is %s: %s", errstr, optarg);
+			break;
+		case 'm':
+			maxrec = strtonum(optarg, 1, INT_MAX - 1, &errstr);
+			if (errstr != NULL)
+				errx(1, "record size is %s: %s", errstr, optarg);
+			break;
+		case 'o':
+			if (npfile == 0)
+				usage();
+			pout[npfile - 1] = optarg;
+			multi = 1;
+			break;
+		case 'P':
+			pmcflag = 1;
+			break;
+		case 'p':
+			proffile = optarg;
+			break;
+		case 'S':
+			servepath = optarg;
+			break;
+		case 's':
+			statsflag = 1;
+			break;
+		case 't':
+			pipelining = 1;
+			break;
+		case 'u':
+			uringing++;
+			break;
 		default:
 			usage();
 		}
@@ -87,45 +149,87 @@ int main(int argc, char *argv[])
 
 	argc -= optind;
 	argv += optind;
+	if (multi && (cachedir != NULL || proffile != NULL || servepath != NULL))
+		usage();
+	if ((njobs > 1 || keyfield != -1) && (multi || servepath != NULL))
+		usage();
+	if (maxrec > 0 && pipelining)
+		usage();
+
+	if (pledge(servepath != NULL ?
+	    "stdio rpath wpath cpath proc exec unix recvfd" :
+	    "stdio rpath wpath cpath proc exec", NULL) == -1) {
+		fprintf(stderr, "%s: pledge: incorrect arguments\n",
+		    getprogname());
+		exit(1);
+	}
 
 	/* no -f; first argument is program */
 	if (npfile == 0) {
-		if (argc <= 1)
+		if (argc < (servepath != NULL ? 1 : 2))
 			usage();
 		   DPRINTF("program = |%s|\n", argv[0]);
-		lexprog = argv[0];
+		lexprog = prog = argv[0];
 		argc--;
 		argv++;
 	}
 
-	if (argc != 1)
+	if (argc != (servepath != NULL ? 0 : 1))
 		usage();
 
 	file = argv[0];
 	yyin = NULL;
-	record_init();
 	symtab_init();
+	record_init();
 
 	signal(SIGFPE, fpecatch);
 
+	if (pmcflag || statsflag) {
+		phase_init(pmcflag, statsflag);
+		phase_enter(PH_PARSE);
+	}
 	compile_time = 1;
-	yyparse();
+	if (multi)
+		multi_init(pout);
+	else if (cachedir == NULL || !cache_load(cachedir, prog)) {
+		yyparse();
+		if (cachedir != NULL && errorflag == 0)
+			cache_save();
+	}
 	   DPRINTF("errorflag=%d\n", errorflag);
 
 	setlocale(LC_NUMERIC, ""); /* back to whatever it is locally */
 	if (errorflag == 0) {
+		if (!multi)
+			opt_program(rootnode);
+		if (proffile != NULL)
+			prof_init(proffile, rootnode, prog);
 		compile_time = 0;
+		outfile = stdout;
 
+		if (servepath != NULL)
+			serve(servepath);
 		if (*file == '-' && *(file+1) == '\0')
 			infile = stdin;
 		else if ((infile = fopen(file, "r")) == NULL)
 			err(1, "can't open file %s", file);
+		else
+			index_load(file, infile);
 
-		execute(rootnode);
+		if (phasing)
+			phase_enter(PH_EVAL);
+		if (multi)
+			errorflag = multi_run(infile);
+		else if (njobs > 1 && keyfield != -1)
+			errorflag = par_keyed(infile, rootnode, njobs, keyfield);
+		else if (njobs > 1 && par_ok(rootnode, infile))
+			errorflag = par_run(infile, rootnode, njobs);
+		else
+			execute(rootnode);
 	} else
 		bracecheck();
 
-	if (infile != stdin)
+	if (infile != NULL && infile != stdin)
 		fclose(infile);
 
 	return errorflag;
@@ -0,0 +1,239 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Several programs over one input, enabled by -o.
+ *
+ * When -o follows a -f, every -f is a program of its own, with its own
+ * symbol table and output (stdout if it has no -o, or -o -), instead
+ * of a part of a single program.  The
+ * input is read and split once: each record is handed to the programs
+ * in turn, which share its fields.  A program assigning to the record
+ * or a field gets it back intact for the next program.  The record a
+ * program leaves its main rules with is kept for its END.
+ *
+ * Switching programs is a matter of pointing the globals of the symbol
+ * table, NR, NF and the output at the ones of the program.  Only the
+ * general loop of f_program() is used: no prefilter, kernel or counting
+ * fast path.
+ */
+
+#include <err.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "awk.h"
+
+struct prog {
+	Node		*root;
+	FILE		*out;
+	const char	*outname;
+	struct symtab	*symtab;
+	Cell		*literal0, *nullloc, *subseploc;
+	Node		*nullnode;
+	Cell		*nrloc, *nfloc;
+	int		 done;		/* exit was run */
+	int		 status;
+	char		*rec;		/* $0 for END, see multi_save() */
+	int		 recsize;
+	int		 hasrec;	/* else $0 is the last record */
+	int		 recdirty;	/* rec was changed by the program */
+};
+
+extern struct symtab	*symtab;
+extern Cell		*literal0, *nullloc, *subseploc, *nrloc, *nfloc;
+extern FILE		*outfile;
+extern jmp_buf		 env;
+extern int		 recdirty;
+extern Cell		**fldtab;
+
+struct prog	*progs;
+int		 nprogs;
+
+void		 multi_switch(struct prog *);
+void		 multi_exec(struct prog *, Node *);
+void		 multi_save(struct prog *);
+
+/*
+ * parse every -f file as a program, writing to outs[i] or stdout
+ */
+void
+multi_init(char **outs)
+{
+	extern int npfile, curpfile;
+	extern FILE *yyin;
+	extern Node *beginloc, *endloc;
+	struct prog *p;
+	int i, n = npfile;
+
+	progs = xcalloc(n, sizeof(*progs));
+	for (i = 0; i < n; i++) {
+		if (i > 0) {
+			symtab_init();
+			record_symtab();
+		}
+		beginloc = endloc = rootnode = NULL;
+		yyin = NULL;
+		curpfile = i;
+		npfile = i + 1;
+		yyparse();
+		if (errorflag)
+			return;
+
+		p = &progs[nprogs++];
+		p->root = rootnode;
+		p->symtab = symtab;
+		p->literal0 = literal0;
+		p->nullloc = nullloc;
+		p->subseploc = subseploc;
+		p->nullnode = nullnode;
+		p->nrloc = nrloc;
+		p->nfloc = nfloc;
+		p->outname = outs[i];
+		if (outs[i] == NULL || strcmp(outs[i], "-") == 0)
+			p->out = stdout;
+		else if ((p->out = fopen(outs[i], "w")) == NULL)
+			err(1, "can't open %s", outs[i]);
+	}
+}
+
+void
+multi_switch(struct prog *p)
+{
+	symtab = p->symtab;
+	literal0 = p->literal0;
+	nullloc = p->nullloc;
+	subseploc = p->subseploc;
+	nullnode = p->nullnode;
+	nrloc = p->nrloc;
+	NR = &nrloc->fval;
+	nfloc = p->nfloc;
+	NF = &nfloc->fval;
+	rootnode = p->root;
+	outfile = p->out;
+	errorflag = p->status;
+}
+
+/*
+ * run a part of the program p, as f_program() does
+ */
+void
+multi_exec(struct prog *p, Node *a)
+{
+	if (setjmp(env) == 0)
+		tcell_put(execute(a));
+	else
+		p->done = 1;
+	p->status = errorflag;
+}
+
+/*
+ * keep the record of p, changed by it or the one it exited on
+ *
+ * as at the end of the input in f_program(), $0 is not rebuilt from
+ * fields changed since unless p ran exit.
+ */
+void
+multi_save(struct prog *p)
+{
+	extern char *record;
+	extern int donerec;
+	char *s;
+	int len;
+
+	if (p->done || donerec)
+		s = sval_get(fldtab[0]);
+	else
+		s = record;
+	len = strlen(s);
+	xadjbuf(&p->rec, &p->recsize, len+1, RECSIZE, NULL, "multi_save");
+	memcpy(p->rec, s, len+1);
+	p->hasrec = 1;
+	p->recdirty = recdirty;
+}
+
+/*
+ * run all the programs over the input, returns the first non-zero
+ * exit status
+ */
+int
+multi_run(FILE *in)
+{
+	struct prog *p, *end = progs + nprogs;
+	char *r, *last;
+	size_t len;
+	int live = 0, status = 0;
+
+	for (p = progs; p < end; p++) {
+		multi_switch(p);
+		if (p->root->narg[0] != NULL)
+			multi_exec(p, p->root->narg[0]);
+		if (p->done)
+			multi_save(p);
+		if (recdirty)
+			record_set("", 0);
+		if (p->root->narg[1] == NULL && p->root->narg[2] == NULL)
+			p->done = 1;
+		if (!p->done)
+			live++;
+	}
+
+	while (live > 0 && record_next(in, &r, &len) > 0) {
+		record_set(r, len);
+		for (p = progs; p < end; p++) {
+			if (p->done)
+				continue;
+			multi_switch(p);
+			record_sync();
+			fval_set(nrloc, nrloc->fval + 1);
+			multi_exec(p, p->root->narg[1]);
+			p->hasrec = 0;
+			if (recdirty || p->done)
+				multi_save(p);
+			if (recdirty)
+				record_set(r, len);	/* for the next program */
+			if (p->done)
+				live--;
+		}
+	}
+
+	/* the last record, as read */
+	last = xstrdup(sval_get(fldtab[0]));
+	for (p = progs; p < end; p++) {
+		multi_switch(p);
+		if (p->hasrec) {
+			record_set(p->rec, strlen(p->rec));
+			recdirty = p->recdirty;
+		} else
+			record_set(last, strlen(last));
+		if (p->root->narg[2] != NULL)
+			multi_exec(p, p->root->narg[2]);
+		if (fflush(p->out) == EOF || ferror(p->out))
+			err(1, "write error on %s", p->outname ?
+			    p->outname : "stdout");
+		if (p->out != stdout)
+			fclose(p->out);
+		if (status == 0)
+			status = p->status;
+		free(p->rec);
+	}
+	free(last);
+	return status;
+}
@@ -23,6 +23,7 @@ ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
 THIS SOFTWARE.
 ****************************************************************/
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -32,47 +33,54 @@ THIS SOFTWARE.
 Node	*rootnode = NULL;	/* root of parse tree */
 Node	*nullnode;	/* zero&null, converted into a node for comparisons */
 
-void		 nodeinit(int, Node *);
 Node		*nodealloc(int);
 Node		*node1(int, Node *);
 Node		*node2(int, Node *, Node *);
 Node		*node3(int, Node *, Node *, Node *);
 Node		*node4(int, Node *, Node *, Node *, Node *);
 
+/* bumped when the grammar changes the trees it builds */
+#define	NODEVERSION	1
+
 struct
 {	int value;
 	Cell *(*func)(Node **, int);
+	int nargs;
 } functions[] = {
-	{ PROGRAM,	f_program },
-	{ NE,		f_relop },
-	{ EQ,		f_relop },
-	{ LE,		f_relop },
-	{ LT,		f_relop },
-	{ GE,		f_relop },
-	{ GT,		f_relop },
-	{ INDIRECT,	f_indirect },
-	{ ADD,		f_arith },
-	{ MINUS,	f_arith },
-	{ MULT,		f_arith },
-	{ DIVIDE,	f_arith },
-	{ MOD,		f_arith },
-	{ UMINUS,	f_arith },
-	{ PREINCR,	f_incrdecr },
-	{ POSTINCR,	f_incrdecr },
-	{ PREDECR,	f_incrdecr },
-	{ POSTDECR,	f_incrdecr },
-	{ PASTAT,	f_pastat },
-	{ PRINTF,	f_printf },
-	{ PRINT,	f_print },
-	{ ASSIGN,	f_assign },
-	{ ADDEQ,	f_assign },
-	{ SUBEQ,	f_assign },
-	{ MULTEQ,	f_assign },
-	{ DIVEQ,	f_assign },
-	{ MODEQ,	f_assign },
-	{ CONDEXPR,	f_condexpr },
-	{ IF,		f_if },
-	{ EXIT,		f_jump },
+	{ PROGRAM,	f_program,	3 },
+	{ NE,		f_relop,	2 },
+	{ EQ,		f_relop,	2 },
+	{ LE,		f_relop,	2 },
+	{ LT,		f_relop,	2 },
+	{ GE,		f_relop,	2 },
+	{ GT,		f_relop,	2 },
+	{ INDIRECT,	f_indirect,	1 },
+	{ ADD,		f_arith,	2 },
+	{ MINUS,	f_arith,	2 },
+	{ MULT,		f_arith,	2 },
+	{ DIVIDE,	f_arith,	2 },
+	{ MOD,		f_arith,	2 },
+	{ UMINUS,	f_arith,	1 },
+	{ PREINCR,	f_incrdecr,	1 },
+	{ POSTINCR,	f_incrdecr,	1 },
+	{ PREDECR,	f_incrdecr,	1 },
+	{ POSTDECR,	f_incrdecr,	1 },
+	{ PASTAT,	f_pastat,	2 },
+	{ PRINTF,	f_printf,	1 },
+	{ PRINT,	f_print,	1 },
+	{ ASSIGN,	f_assign,	2 },
+	{ ADDEQ,	f_assign,	2 },
+	{ SUBEQ,	f_assign,	2 },
+	{ MULTEQ,	f_assign,	2 },
+	{ DIVEQ,	f_assign,	2 },
+	{ MODEQ,	f_assign,	2 },
+	{ CONDEXPR,	f_condexpr,	3 },
+	{ IF,		f_if,	3 },
+	{ EXIT,		f_jump,	1 },
+	{ ARRAY,	f_array,	2 },
+	{ INTEST,	f_intest,	2 },
+	{ FORIN,	f_forin,	3 },
+	{ DELETE,	f_delete,	2 },
 };
 
 void
@@ -93,14 +101,50 @@ nodeinit(int a, Node *x)
 	x->proc = functions[i].func;
 }
 
+/*
+ * number of arguments of a Node of nobj a, -1 if there is no such Node
+ */
+int
+nodeargs(int a)
+{
+	int i;
+
+	for (i = 0; i < nitems(functions); i++) {
+		if (a == functions[i].value)
+			return functions[i].nargs;
+	}
+	return -1;
+}
+
+/*
+ * fingerprint of the layout of the trees, for their images
+ */
+uint64_t
+nodelayout(void)
+{
+	int v[2 * nitems(functions) + 4];
+	int i, n = 0;
+
+	v[n++] = NODEVERSION;
+	v[n++] = sizeof(Node);
+	v[n++] = sizeof(Cell);
+	v[n++] = INDIRECT;		/* the last token */
+	for (i = 0; i < nitems(functions); i++) {
+		v[n++] = functions[i].value;
+		v[n++] = functions[i].nargs;
+	}
+	return hash(v, sizeof(v));
+}
+
 Node *
 nodealloc(int n)
 {
 	Node *x;
 
-	x = xmalloc(sizeof(Node) + (n-1)*sizeof(Node *));
+	x = arena_alloc(sizeof(Node) + (n-1)*sizeof(Node *));
 	x->nnext = NULL;
 	x->lineno = lineno;
+	x->nargs = n;
 	return x;
 }
 
@@ -0,0 +1,530 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Static analysis of the parse tree, run once after yyparse().
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "awk.h"
+#include "ytab.h"
+
+#define	isvalue(n)	((n)->ntype == NVALUE)
+#define	isop(n, o)	((n)->ntype != NVALUE && (n)->nobj == (o))
+#define	ncell(n)	((Cell *)(n)->narg[0])
+
+/*
+ * Literals required by the main rules.  If a record contains none of
+ * them, no pattern of the program can match it.
+ */
+#define	MAXPRELIT	64
+static char	*prelits[MAXPRELIT];
+static size_t	 prelens[MAXPRELIT];
+static int	 nprelits = 0;
+
+/*
+ * 1 if neither the main rules nor END look at $0, its fields or NF:
+ * records then only need to be counted.
+ */
+int		 nofields = 0;
+
+/*
+ * Fused loop replacing the main rules, if they match an idiom.
+ */
+struct kernel	*kernel = NULL;
+
+/*
+ * 1 if the main rules are a single `pattern { print($0) }': matching
+ * records can be copied from the input buffer to the output.
+ */
+int		 passthrough = 0;
+
+/*
+ * Range of NR out of which no main rule can match, if there is one:
+ * the records before nrfirst are only counted, and none is read after
+ * nrlast, 0 for no end, or only counted if nrcount is set because END
+ * uses NR.
+ */
+double		 nrfirst = 1;
+double		 nrlast = 0;
+int		 nrcount = 0;
+
+static const char	*opt_eqlit(Node *);
+static int		 opt_isfield(Node *);
+static int		 opt_isrecprint(Node *);
+static int		 opt_usesfields(Node *);
+static void		 opt_prefilter(Node *);
+static int		 opt_kfield(Node *);
+static int		 opt_kacc(Node *, struct kernel *);
+static void		 opt_kernel(Node *);
+static int		 opt_nrbound(Node *, double *, double *);
+static int		 opt_hascell(Node *, Cell *);
+static int		 opt_setscell(Node *, Cell *);
+static void		 opt_nrrange(Node *);
+
+void
+opt_program(Node *root)
+{
+	Node *r;
+
+	if (root == NULL)
+		return;
+	opt_prefilter(root->narg[1]);
+	if (!opt_usesfields(root->narg[1]) && !opt_usesfields(root->narg[2]))
+		nofields = 1;
+	   DPRINTF("nofields: %d\n", nofields);
+	if ((r = root->narg[1]) != NULL && r->nnext == NULL && isop(r, PASTAT) &&
+	    opt_isrecprint(r->narg[1]))
+		passthrough = 1;
+	   DPRINTF("passthrough: %d\n", passthrough);
+	opt_nrrange(root);
+	/* $0 is not kept up to date by the kernels */
+	if (!nofields && !opt_usesfields(root->narg[2]))
+		opt_kernel(root->narg[1]);
+}
+
+/*
+ * Does the code rooted at `n' reference $0, a field or NF?
+ */
+static int
+opt_usesfields(Node *n)
+{
+	extern Cell *nfloc;
+	int i;
+
+	for (; n != NULL; n = n->nnext) {
+		if (isvalue(n)) {
+			if (ncell(n) == nfloc)
+				return 1;
+			continue;
+		}
+		if (n->nobj == INDIRECT)
+			return 1;
+		for (i = 0; i < n->nargs; i++) {
+			if (opt_usesfields(n->narg[i]))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Is `n' a field reference $e whose index evaluation has no side effect?
+ */
+static int
+opt_isfield(Node *n)
+{
+	Node *e;
+
+	if (!isop(n, INDIRECT))
+		return 0;
+	e = n->narg[0];
+	return isvalue(e);
+}
+
+/*
+ * Is `n' the single statement `print($0)'?
+ */
+static int
+opt_isrecprint(Node *n)
+{
+	Node *e;
+	Cell *x;
+
+	if (n == NULL || n->nnext != NULL || !isop(n, PRINT))
+		return 0;
+	if ((e = n->narg[0]) == NULL || e->nnext != NULL)
+		return 0;
+	if (!opt_isfield(e))
+		return 0;
+	x = ncell(e->narg[0]);
+	return x->ctype == CCON && (x->tval & NUM) && x->fval == 0;
+}
+
+/*
+ * If `n' is a pattern of the form `$e == "lit"' return "lit".
+ *
+ * A field is a substring of the record it has been split from, so
+ * such a pattern can only be true if the record contains "lit".  The
+ * constant must be a non-numeric, non-empty string: otherwise the
+ * comparison might be numeric or match a field past NF.
+ */
+static const char *
+opt_eqlit(Node *n)
+{
+	Node *f, *c;
+	Cell *x;
+
+	if (n == NULL || !isop(n, EQ))
+		return NULL;
+	f = n->narg[0];
+	c = n->narg[1];
+	if (isvalue(f)) {
+		f = n->narg[1];
+		c = n->narg[0];
+	}
+	if (!isvalue(c) || !opt_isfield(f))
+		return NULL;
+	x = ncell(c);
+	if (x->ctype != CCON || (x->tval & (STR|NUM)) != STR)
+		return NULL;
+	if (x->sval == NULL || *x->sval == '\0')
+		return NULL;
+	return x->sval;
+}
+
+/*
+ * Collect the literals of the main rules.  The prefilter is enabled
+ * only if every rule has one: a rule that did not fire cannot change
+ * the state seen by the following patterns.
+ */
+static void
+opt_prefilter(Node *rules)
+{
+	const char *lit;
+	Node *r;
+	int n = 0;
+
+	for (r = rules; r != NULL; r = r->nnext) {
+		if (!isop(r, PASTAT))
+			return;
+		if ((lit = opt_eqlit(r->narg[0])) == NULL)
+			return;
+		if (n >= MAXPRELIT)
+			return;
+		prelens[n] = strlen(lit);
+		prelits[n++] = (char *)lit;
+	}
+	nprelits = n;
+	   DPRINTF("prefilter: %d literal(s)\n", nprelits);
+}
+
+/*
+ * If `n' is $k, with k a constant, return k.
+ */
+static int
+opt_kfield(Node *n)
+{
+	Cell *x;
+	int k;
+
+	if (!opt_isfield(n))
+		return -1;
+	x = ncell(n->narg[0]);
+	if (x->ctype != CCON || !(x->tval & NUM))
+		return -1;
+	k = (int)x->fval;
+	if (k < 0 || k > MAXKFIELD || k != x->fval)
+		return -1;
+	return k;
+}
+
+/*
+ * Are all statements of `n' accumulators, `v += $k' or `v++'?
+ */
+static int
+opt_kacc(Node *n, struct kernel *k)
+{
+	extern Cell *nrloc, *nfloc;
+	Cell *v;
+	int i, f;
+
+	for (; n != NULL; n = n->nnext) {
+		if (k->nacc >= MAXKACC || isvalue(n))
+			return 0;
+		if (isop(n, ADDEQ)) {
+			if ((f = opt_kfield(n->narg[1])) == -1)
+				return 0;
+		} else if (isop(n, POSTINCR) || isop(n, PREINCR))
+			f = -1;
+		else
+			return 0;
+		if (!isvalue(n->narg[0]))
+			return 0;
+		v = ncell(n->narg[0]);
+		if (v->ctype != CVAR || v == nrloc || v == nfloc)
+			return 0;
+		/* each variable once, to keep the order of additions */
+		for (i = 0; i < k->nacc; i++) {
+			if (k->kacc[i].cell == v)
+				return 0;
+		}
+		k->kacc[k->nacc].cell = v;
+		k->kacc[k->nacc].field = f;
+		k->nacc++;
+		if (f > k->kmaxfield)
+			k->kmaxfield = f;
+	}
+	return 1;
+}
+
+/*
+ * Look for a single rule `[$k relop c] { accumulators }' or
+ * `$k relop c { anything }'.
+ */
+static void
+opt_kernel(Node *rules)
+{
+	struct kernel k;
+	Node *r, *p, *f, *c;
+	Cell *x;
+
+	r = rules;
+	if (r == NULL || r->nnext != NULL || !isop(r, PASTAT))
+		return;
+	memset(&k, 0, sizeof(k));
+	k.krule = r;
+	k.kfield = -1;
+	k.kmaxfield = -1;
+	if ((p = r->narg[0]) != NULL) {
+		if (!isop(p, EQ) && !isop(p, NE) && !isop(p, LT) &&
+		    !isop(p, LE) && !isop(p, GT) && !isop(p, GE))
+			return;
+		f = p->narg[0];
+		c = p->narg[1];
+		k.krelop = p->nobj;
+		if (isvalue(f)) {
+			f = p->narg[1];
+			c = p->narg[0];
+			/* c < $k is $k > c */
+			switch (p->nobj) {
+			case LT:	k.krelop = GT; break;
+			case LE:	k.krelop = GE; break;
+			case GT:	k.krelop = LT; break;
+			case GE:	k.krelop = LE; break;
+			}
+		}
+		if (!isvalue(c) || (k.kfield = opt_kfield(f)) == -1)
+			return;
+		x = ncell(c);
+		if (x->ctype != CCON || !(x->tval & NUM))
+			return;
+		k.kconst = x->fval;
+		k.kmaxfield = k.kfield;
+	}
+	if (!opt_kacc(r->narg[1], &k)) {
+		if (k.kfield == -1)
+			return;
+		k.nacc = 0;
+		k.kmaxfield = k.kfield;
+		k.kbody = r->narg[1];
+	}
+	kernel = arena_alloc(sizeof(*kernel));
+	*kernel = k;
+	   DPRINTF("kernel: filter $%d, %d accumulator(s)\n", k.kfield, k.nacc);
+}
+
+/*
+ * If `p' is `NR relop c', with c a number, narrow [*lo, *hi] to the
+ * values of NR for which it is true.
+ */
+static int
+opt_nrbound(Node *p, double *lo, double *hi)
+{
+	extern Cell *nrloc;
+	Node *v, *c;
+	Cell *x;
+	double k;
+	int op;
+
+	if (p == NULL || (!isop(p, EQ) && !isop(p, LT) && !isop(p, LE) &&
+	    !isop(p, GT) && !isop(p, GE)))
+		return 0;
+	v = p->narg[0];
+	c = p->narg[1];
+	op = p->nobj;
+	if (isvalue(v) && ncell(v) != nrloc) {
+		v = p->narg[1];
+		c = p->narg[0];
+		/* c < NR is NR > c */
+		switch (op) {
+		case LT:	op = GT; break;
+		case LE:	op = GE; break;
+		case GT:	op = LT; break;
+		case GE:	op = LE; break;
+		}
+	}
+	if (!isvalue(v) || ncell(v) != nrloc || !isvalue(c))
+		return 0;
+	x = ncell(c);
+	if (x->ctype != CCON || (x->tval & (STR|NUM)) != NUM)
+		return 0;
+	k = x->fval;
+	/* NR is a whole number */
+	switch (op) {
+	case EQ:
+		if (k != floor(k))
+			*hi = 0;
+		if (k > *lo)
+			*lo = k;
+		if (k < *hi)
+			*hi = k;
+		break;
+	case LT:
+		if (ceil(k) - 1 < *hi)
+			*hi = ceil(k) - 1;
+		break;
+	case LE:
+		if (floor(k) < *hi)
+			*hi = floor(k);
+		break;
+	case GT:
+		if (floor(k) + 1 > *lo)
+			*lo = floor(k) + 1;
+		break;
+	case GE:
+		if (ceil(k) > *lo)
+			*lo = ceil(k);
+		break;
+	}
+	return 1;
+}
+
+/*
+ * Does the code rooted at `n' use cell `c'?
+ */
+static int
+opt_hascell(Node *n, Cell *c)
+{
+	int i;
+
+	for (; n != NULL; n = n->nnext) {
+		if (isvalue(n)) {
+			if (ncell(n) == c)
+				return 1;
+			continue;
+		}
+		for (i = 0; i < n->nargs; i++) {
+			if (opt_hascell(n->narg[i], c))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Does the code rooted at `n' assign to cell `c'?
+ */
+static int
+opt_setscell(Node *n, Cell *c)
+{
+	int i;
+
+	for (; n != NULL; n = n->nnext) {
+		if (isvalue(n))
+			continue;
+		switch (n->nobj) {
+		case ASSIGN:
+		case ADDEQ:
+		case SUBEQ:
+		case MULTEQ:
+		case DIVEQ:
+		case MODEQ:
+		case PREINCR:
+		case POSTINCR:
+		case PREDECR:
+		case POSTDECR:
+			if (isvalue(n->narg[0]) && ncell(n->narg[0]) == c)
+				return 1;
+			break;
+		}
+		for (i = 0; i < n->nargs; i++) {
+			if (opt_setscell(n->narg[i], c))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Work out the range of NR of the main rules, if each one has a pattern
+ * on NR, or no pattern and a body `if (NR relop c) statement'.  A rule
+ * whose pattern is false is not run, so the records out of the range
+ * only change NR.
+ */
+static void
+opt_nrrange(Node *root)
+{
+	extern Cell *nrloc;
+	double lo = HUGE_VAL, hi = 0, rlo, rhi;
+	Node *r, *b;
+	int i;
+
+	if (root->narg[1] == NULL)
+		return;
+	for (i = 0; i < 3; i++) {
+		if (opt_setscell(root->narg[i], nrloc))
+			return;
+	}
+	/* $0 in END is the last record */
+	if (opt_usesfields(root->narg[2]))
+		return;
+	for (r = root->narg[1]; r != NULL; r = r->nnext) {
+		if (!isop(r, PASTAT))
+			return;
+		rlo = 1;
+		rhi = HUGE_VAL;
+		if (r->narg[0] != NULL && !opt_nrbound(r->narg[0], &rlo, &rhi))
+			return;
+		b = r->narg[1];
+		if (b != NULL && b->nnext == NULL && isop(b, IF) &&
+		    b->narg[2] == NULL)
+			opt_nrbound(b->narg[0], &rlo, &rhi);
+		if (rlo > rhi)
+			continue;	/* never matches */
+		if (rlo < lo)
+			lo = rlo;
+		if (rhi > hi)
+			hi = rhi;
+	}
+	if (lo > hi || (lo <= 1 && hi == HUGE_VAL))
+		return;
+	nrfirst = lo;
+	if (hi != HUGE_VAL)
+		nrlast = hi;
+	nrcount = nrlast != 0 && opt_hascell(root->narg[2], nrloc);
+	if (pipelining) {
+		/* the input is read ahead by the threads */
+		nrfirst = 1;
+		if (nrcount)
+			nrlast = nrcount = 0;
+	}
+	   DPRINTF("nr range: %.0f to %.0f, count %d\n", nrfirst, nrlast,
+	       nrcount);
+}
+
+/*
+ * Return 1 if record `r' of `len' bytes might be matched by a main rule.
+ */
+int
+prefilter_match(const char *r, size_t len)
+{
+	int i;
+
+	if (nprelits == 0)
+		return 1;
+	for (i = 0; i < nprelits; i++) {
+		if (memmem(r, len, prelits[i], prelens[i]) != NULL)
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,463 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Parallel runs of stateless programs, enabled by -j.
+ *
+ * A program is stateless if its main rules only change the current
+ * record: they assign nothing but fields, and do not exit, delete or
+ * test array membership, since looking at an element creates it.
+ * It has no END and its BEGIN prints nothing and does not look at NR.
+ * The output for a record then only depends on the record and on NR.
+ *
+ * The input file is cut in ranges of whole records, each run by a
+ * worker process.  The first worker writes to the standard output and
+ * error, the others to temporary files, copied in order once the
+ * workers before them are done, so that only the first worker to fail
+ * reports it.  A worker starts with NR set to the number of records
+ * before its range.
+ *
+ * With -k, any program runs in each worker, which gets the records
+ * whose key field hashes to it, sent on a pipe.  The outputs of the
+ * workers are written one after the other.
+ *
+ * Workers are processes, not threads: the interpreter state is global.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "awk.h"
+#include "ytab.h"
+
+#define	isvalue(n)	((n)->ntype == NVALUE)
+#define	isop(n, o)	((n)->ntype != NVALUE && (n)->nobj == (o))
+#define	ncell(n)	((Cell *)(n)->narg[0])
+
+#define	MAXJOBS		256
+
+struct pbuf {
+	int		 fd;		/* -1 once the worker is gone */
+	size_t		 len;
+	char		 buf[64 * 1024];
+};
+
+int		 par_pure(Node *);
+int		 par_has(Node *, int, Cell *);
+FILE		*par_output(int);
+__dead void	 par_worker(Node *, FILE *, FILE *);
+int		 par_wait(pid_t *, FILE **, FILE **, int);
+char		*par_key(char *, int, size_t *);
+void		 par_put(struct pbuf *, const char *, size_t);
+void		 par_flush(struct pbuf *);
+void		 par_write(struct pbuf *, const char *, size_t);
+off_t		 par_cut(int, off_t, off_t);
+int		 par_copy(FILE *, int);
+
+/*
+ * Can `root' run in parallel on `inf'?
+ */
+int
+par_ok(Node *root, FILE *inf)
+{
+	extern Cell *nrloc;
+	struct stat st;
+
+	if (root == NULL || root->narg[2] != NULL || phasing || profiling)
+		return 0;
+	if (par_has(root->narg[0], PRINT, NULL) ||
+	    par_has(root->narg[0], PRINTF, NULL) ||
+	    par_has(root->narg[0], 0, nrloc))
+		return 0;
+	if (!par_pure(root->narg[1]))
+		return 0;
+	/* NR is counted in newlines, not in the pieces of long records */
+	if (maxrec > 0 && par_has(root->narg[1], 0, nrloc))
+		return 0;
+	if (fstat(fileno(inf), &st) == -1 || !S_ISREG(st.st_mode))
+		return 0;
+	return 1;
+}
+
+/*
+ * Does the code rooted at `n' only change fields?
+ */
+int
+par_pure(Node *n)
+{
+	int i;
+
+	for (; n != NULL; n = n->nnext) {
+		if (isvalue(n))
+			continue;
+		switch (n->nobj) {
+		case ASSIGN:
+		case ADDEQ:
+		case SUBEQ:
+		case MULTEQ:
+		case DIVEQ:
+		case MODEQ:
+		case PREINCR:
+		case POSTINCR:
+		case PREDECR:
+		case POSTDECR:
+			if (!isop(n->narg[0], INDIRECT))
+				return 0;
+			break;
+		case EXIT:
+		case DELETE:
+		case FORIN:
+		case INTEST:
+			return 0;
+		}
+		for (i = 0; i < n->nargs; i++) {
+			if (!par_pure(n->narg[i]))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Does the code rooted at `n' use operator `op' or cell `c'?
+ */
+int
+par_has(Node *n, int op, Cell *c)
+{
+	int i;
+
+	for (; n != NULL; n = n->nnext) {
+		if (isvalue(n)) {
+			if (c != NULL && ncell(n) == c)
+				return 1;
+			continue;
+		}
+		if (op != 0 && n->nobj == op)
+			return 1;
+		for (i = 0; i < n->nargs; i++) {
+			if (par_has(n->narg[i], op, c))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * run the program with `njobs' workers, returns the exit status
+ */
+int
+par_run(FILE *inf, Node *root, int njobs)
+{
+	off_t start[MAXJOBS + 1];
+	double nr[MAXJOBS];
+	FILE *out[MAXJOBS], *errs[MAXJOBS];
+	pid_t pid[MAXJOBS];
+	struct stat st;
+	int i;
+
+	if (njobs > MAXJOBS)
+		njobs = MAXJOBS;
+	if (fstat(fileno(inf), &st) == -1)
+		FATAL("can't stat input");
+	for (i = 0; i < njobs; i++) {
+		/* with an index, as many records and no NR to count */
+		if (index_chunk(i, njobs, &start[i], &nr[i]))
+			continue;
+		start[i] = i == 0 ? 0 : par_cut(fileno(inf),
+		    st.st_size * i / njobs, start[i - 1]);
+		/* counted by the worker, for NR and its error messages */
+		nr[i] = -1;
+	}
+	start[njobs] = st.st_size;
+	   DPRINTF("par: %d jobs, %lld bytes\n", njobs, (long long)st.st_size);
+
+	fflush(stdout);
+	for (i = 0; i < njobs; i++) {
+		out[i] = par_output(i);
+		errs[i] = par_output(i);
+		if ((pid[i] = fork()) == -1)
+			FATAL("can't fork");
+		if (pid[i] == 0) {
+			/* the range is read here, not by the pipeline */
+			pipelining = 0;
+			record_range(inf, start[i], start[i + 1], nr[i]);
+			par_worker(root, out[i], errs[i]);
+		}
+	}
+	return par_wait(pid, out, errs, njobs);
+}
+
+/*
+ * run the whole program in `njobs' workers, each getting the records
+ * whose field `key' hashes to it, returns the exit status
+ */
+int
+par_keyed(FILE *inf, Node *root, int njobs, int key)
+{
+	extern FILE *infile;
+	struct pbuf *pb;
+	FILE *out[MAXJOBS], *errs[MAXJOBS];
+	pid_t pid[MAXJOBS];
+	int pfd[MAXJOBS][2];
+	char *r, *k;
+	size_t len, klen;
+	int i, j;
+
+	if (njobs > MAXJOBS)
+		njobs = MAXJOBS;
+	for (i = 0; i < njobs; i++) {
+		if (pipe(pfd[i]) == -1)
+			FATAL("can't create pipe");
+	}
+	fflush(stdout);
+	for (i = 0; i < njobs; i++) {
+		out[i] = par_output(i);
+		errs[i] = par_output(i);
+		if ((pid[i] = fork()) == -1)
+			FATAL("can't fork");
+		if (pid[i] == 0) {
+			for (j = 0; j < njobs; j++) {
+				close(pfd[j][1]);
+				if (j != i)
+					close(pfd[j][0]);
+			}
+			if ((infile = fdopen(pfd[i][0], "r")) == NULL)
+				FATAL("can't open worker input");
+			par_worker(root, out[i], errs[i]);
+		}
+	}
+
+	/* a worker may stop reading, by exit or an error */
+	signal(SIGPIPE, SIG_IGN);
+	pb = xcalloc(njobs, sizeof(*pb));
+	for (i = 0; i < njobs; i++) {
+		close(pfd[i][0]);
+		pb[i].fd = pfd[i][1];
+		pb[i].len = 0;
+	}
+	while (record_next(inf, &r, &len) > 0) {
+		if (key == 0) {
+			k = r;
+			klen = len;
+		} else
+			k = par_key(r, key, &klen);
+		par_put(&pb[hash(k, klen) % njobs], r, len);
+	}
+	for (i = 0; i < njobs; i++) {
+		par_flush(&pb[i]);
+		if (pb[i].fd != -1)
+			close(pb[i].fd);
+	}
+	xfree(pb);
+	return par_wait(pid, out, errs, njobs);
+}
+
+/*
+ * where worker i writes its output or errors: the standard output or
+ * error for the first one, the others are copied there later
+ */
+FILE *
+par_output(int i)
+{
+	FILE *fp;
+
+	if (i == 0)
+		return NULL;
+	if ((fp = tmpfile()) == NULL)
+		FATAL("can't create temporary file");
+	return fp;
+}
+
+__dead void
+par_worker(Node *root, FILE *out, FILE *errs)
+{
+	if (errs != NULL && dup2(fileno(errs), STDERR_FILENO) == -1)
+		FATAL("can't redirect errors");
+	if (out != NULL && dup2(fileno(out), STDOUT_FILENO) == -1)
+		FATAL("can't redirect output");
+	execute(root);
+	fflush(stdout);
+	_exit(errorflag);
+}
+
+/*
+ * wait for the workers in order and copy their output and errors,
+ * returns the first non zero exit status
+ */
+int
+par_wait(pid_t *pid, FILE **out, FILE **errs, int njobs)
+{
+	int i, k, status, ret = 0;
+
+	for (i = 0; i < njobs; i++) {
+		while (waitpid(pid[i], &status, 0) == -1) {
+			if (errno != EINTR)
+				FATAL("waitpid");
+		}
+		if (out[i] != NULL) {
+			if (par_copy(out[i], STDOUT_FILENO) == -1)
+				FATAL("write error");
+			fclose(out[i]);
+		}
+		if (errs[i] != NULL) {
+			par_copy(errs[i], STDERR_FILENO);
+			fclose(errs[i]);
+		}
+		if (WIFEXITED(status))
+			ret = WEXITSTATUS(status);
+		else
+			ret = 2;
+		if (ret != 0)
+			break;
+	}
+	/* the output stops where a worker failed */
+	for (k = i + 1; k < njobs; k++) {
+		kill(pid[k], SIGTERM);
+		waitpid(pid[k], NULL, 0);
+		if (out[k] != NULL)
+			fclose(out[k]);
+		if (errs[k] != NULL)
+			fclose(errs[k]);
+	}
+	return ret;
+}
+
+/*
+ * return field `k' of record r, empty if there is none
+ */
+char *
+par_key(char *r, int k, size_t *lenp)
+{
+	char *s;
+
+	for (;;) {
+		while (*r == ' ' || *r == '\t' || *r == '\n')
+			r++;
+		s = r;
+		while (*r != ' ' && *r != '\t' && *r != '\n' && *r != '\0')
+			r++;
+		if (--k == 0 || *s == '\0') {
+			*lenp = r - s;
+			return s;
+		}
+	}
+}
+
+/*
+ * append record r of length len to the input of a worker
+ */
+void
+par_put(struct pbuf *pb, const char *r, size_t len)
+{
+	if (pb->len + len + 1 > sizeof(pb->buf)) {
+		par_flush(pb);
+		if (len + 1 > sizeof(pb->buf)) {
+			par_write(pb, r, len);
+			par_write(pb, "\n", 1);
+			return;
+		}
+	}
+	memcpy(pb->buf + pb->len, r, len);
+	pb->buf[pb->len + len] = '\n';
+	pb->len += len + 1;
+}
+
+void
+par_flush(struct pbuf *pb)
+{
+	par_write(pb, pb->buf, pb->len);
+	pb->len = 0;
+}
+
+/*
+ * the input of a worker which is gone is dropped
+ */
+void
+par_write(struct pbuf *pb, const char *s, size_t n)
+{
+	ssize_t w;
+
+	while (pb->fd != -1 && n > 0) {
+		if ((w = write(pb->fd, s, n)) == -1) {
+			if (errno == EINTR)
+				continue;
+			close(pb->fd);
+			pb->fd = -1;
+			break;
+		}
+		s += w;
+		n -= w;
+	}
+}
+
+/*
+ * return the start of the first record at or after `off', not before
+ * `min'
+ */
+off_t
+par_cut(int fd, off_t off, off_t min)
+{
+	char buf[BUFSIZ], *nl;
+	ssize_t r;
+
+	if (off <= min)
+		return min;
+	/* the byte before `off' may end a record */
+	off--;
+	while ((r = pread(fd, buf, sizeof(buf), off)) > 0) {
+		if ((nl = memchr(buf, '\n', r)) != NULL)
+			return off + (nl - buf) + 1;
+		off += r;
+	}
+	if (r == -1)
+		FATAL("read error on input");
+	return off;
+}
+
+/*
+ * copy the output or errors of a worker to fd
+ */
+int
+par_copy(FILE *fp, int fd)
+{
+	char buf[64 * 1024];
+	ssize_t r, w, n;
+
+	if (lseek(fileno(fp), 0, SEEK_SET) == -1)
+		return -1;
+	while ((r = read(fileno(fp), buf, sizeof(buf))) > 0) {
+		for (n = 0; n < r; n += w) {
+			if ((w = write(fd, buf + n, r - n)) == -1) {
+				if (errno == EINTR) {
+					w = 0;
+					continue;
+				}
+				return -1;
+			}
+		}
+	}
+	return r;
+}
@@ -27,8 +27,10 @@ THIS SOFTWARE.
 #include <assert.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "awk.h"
 
 int yywrap(void) { return(1); }
@@ -50,7 +52,8 @@ Node	*endloc = 0;
 %token	<p>	PROGRAM PASTAT XBEGIN XEND
 %token	<i>	NL ',' '{' '(' '|' ';' '/' ')' '}' '[' ']'
 %token	<i>	APPEND EQ GE GT LE LT NE
-%token	<i>	EXIT IF
+%token	<i>	EXIT IF FOR IN DELETE
+%token	<i>	ARRAY INTEST FORIN
 %token	<i>	ADD MINUS MULT DIVIDE MOD
 %token	<i>	ASSIGN ASGNOP ADDEQ SUBEQ MULTEQ DIVEQ MODEQ
 %token	<i>	PRINT PRINTF
@@ -58,11 +61,11 @@ Node	*endloc = 0;
 %token	<i>	POSTINCR PREINCR POSTDECR PREDECR
 %token	<cp>	VAR IVAR NUMBER STRING
 
-%type	<p>	pas pattern plist term
+%type	<p>	pas pattern plist patlist term
 %type	<p>	pa_pat pa_stat pa_stats
 %type	<p>	simple_stmt stmt stmtlist
-%type	<p>	var
-%type	<p>	if else
+%type	<p>	var varname
+%type	<p>	if else for
 %type	<i>	st
 %type	<i>	pst opt_pst lbrace rbrace rparen nl opt_nl
 %type	<i>	print
@@ -70,7 +73,7 @@ Node	*endloc = 0;
 %right	ASGNOP
 %right	'?'
 %right	':'
-%nonassoc APPEND EQ GE GT LE LT NE '|'
+%nonassoc APPEND EQ GE GT LE LT NE IN '|'
 %left	EXIT
 %left	IF NUMBER
 %left	PRINT PRINTF STRING
@@ -93,6 +96,11 @@ else:
 	  ELSE | else NL
 	;
 
+for:
+	  FOR '(' varname IN varname rparen stmt
+		{ $$ = stat3(FORIN, $3, makearr($5), $7); }
+	;
+
 if:
 	  IF '(' pattern rparen		{ $$ = notnull($3); }
 	;
@@ -126,7 +134,7 @@ pa_pat:
 	;
 
 pa_stat:
-	  pa_pat			{ $$ = stat2(PASTAT, $1, stat2(PRINT, record2node(), NULL)); }
+	  pa_pat			{ $$ = stat2(PASTAT, $1, stat1(PRINT, record2node())); }
 	| pa_pat lbrace stmtlist '}'	{ $$ = stat2(PASTAT, $1, $3); }
 	| lbrace stmtlist '}'		{ $$ = stat2(PASTAT, NULL, $2); }
 	| XBEGIN lbrace stmtlist '}'
@@ -150,6 +158,7 @@ pattern:
 	| pattern LE pattern		{ $$ = op2($2, $1, $3); }
 	| pattern LT pattern		{ $$ = op2($2, $1, $3); }
 	| pattern NE pattern		{ $$ = op2($2, $1, $3); }
+	| pattern IN varname		{ $$ = op2(INTEST, $1, makearr($3)); }
 	| term
 	;
 
@@ -158,6 +167,11 @@ plist:
 	| plist ',' pattern		{ $$ = node_link($1, $3); }
 	;
 
+patlist:
+	  pattern
+	| plist
+	;
+
 print:
 	  PRINT | PRINTF
 	;
@@ -177,6 +191,8 @@ rparen:
 simple_stmt:
 	| print '(' pattern ')'		{ $$ = stat1($1, $3); }
 	| print '(' plist ')'		{ $$ = stat1($1, $3); }
+	| DELETE varname '[' patlist ']' { $$ = stat2(DELETE, makearr($2), $4); }
+	| DELETE varname		{ $$ = stat2(DELETE, makearr($2), NULL); }
 	| pattern			{ $$ = exp2stat($1); }
 	| error				{ yyclearin; }
 	;
@@ -189,8 +205,9 @@ st:
 stmt:
 	| EXIT pattern st	{ $$ = stat1(EXIT, $2); }
 	| EXIT st		{ $$ = stat1(EXIT, NULL); }
+	| for
 	| if stmt else stmt	{ $$ = stat3(IF, $1, $2, $4); }
-	| if stmt		{ $$ = stat2(IF, $1, $2); }
+	| if stmt		{ $$ = stat3(IF, $1, $2, NULL); }
 	| lbrace stmtlist rbrace { $$ = $2; }
 	| simple_stmt st
 	| ';' opt_nl		{ $$ = 0; }
@@ -221,11 +238,16 @@ term:
 	;
 
 var:
-	  VAR				{ $$ = cell2node($1, CVAR); }
+	  varname
+	| varname '[' patlist ']'	{ $$ = op2(ARRAY, makearr($1), $3); }
 	| IVAR				{ $$ = op1(INDIRECT, cell2node($1, CVAR)); }
 	| INDIRECT term	 		{ $$ = op1(INDIRECT, $2); }
 	;
 
+varname:
+	  VAR				{ $$ = cell2node($1, CVAR); }
+	;
+
 %%
 
 int	errorflag = 0;
@@ -242,9 +264,12 @@ typedef struct Keyword {
 Keyword keywords[] ={	/* keep sorted: binary searched */
 	{ "BEGIN",	XBEGIN },
 	{ "END",	XEND },
+	{ "delete",	DELETE },
 	{ "else",	ELSE },
 	{ "exit",	EXIT },
+	{ "for",	FOR },
 	{ "if",		IF },
+	{ "in",		IN },
 	{ "print",	PRINT },
 	{ "printf",	PRINTF },
 };
@@ -483,9 +508,9 @@ yylex(void)
 int
 string(void)
 {
-	static char buf[1024];
+	static char buf[1024], s[1024];
 	int c, n;
-	char *s, *bp;
+	char *bp;
 	for (bp = buf; (c = input()) != '"'; ) {
 		if (bp-buf >= sizeof(buf))
 			yyerror("string too long");
@@ -551,9 +576,10 @@ string(void)
 		}
 	}
 	*bp = 0; 
-	s = xstrdup(buf);
+	memcpy(s, buf, bp - buf + 1);
 	*bp++ = ' '; *bp++ = 0;
-	yylval.cp = symtab_set(buf, s, 0.0, CON|STR|DONTFREE);
+	/* freeable, so that assignments can share it */
+	yylval.cp = symtab_set(buf, s, 0.0, CON|STR);
 	RET(STRING);
 }
 
@@ -723,6 +749,8 @@ __dead void FATAL(const char *fmt, ...)
 	error();
 	if (debug > 1)		/* core dump if serious debugging on */
 		abort();
+	if (serving)
+		serve_abort();
 	exit(2);
 }
 
@@ -786,6 +814,25 @@ bclass(int c)
 	}
 }
 
+/*
+ * make the variable of node p an array
+ */
+Node *
+makearr(Node *p)
+{
+	Cell *cp;
+
+	cp = (Cell *)(p->narg[0]);
+	if (cp->tval & CON)
+		yyerror("can't use constant %s as an array", NN(cell_name(cp)));
+	else if (!isarr(cp)) {
+		   DPRINTF("makearr %s\n", NN(cell_name(cp)));
+		cp->sval = (char *)amap_alloc();
+		cp->tval = ARR;
+	}
+	return p;
+}
+
 Node *
 notnull(Node *n)
 {
@@ -818,6 +865,12 @@ tokname(int a)
 		{ NE,		"NE" },
 		{ EXIT,		"EXIT" },
 		{ IF,		"IF" },
+		{ FOR,		"FOR" },
+		{ IN,		"IN" },
+		{ DELETE,	"DELETE" },
+		{ ARRAY,	"ARRAY" },
+		{ INTEST,	"INTEST" },
+		{ FORIN,	"FORIN" },
 		{ ADD,		"ADD" },
 		{ MINUS,	"MINUS" },
 		{ MULT,		"MULT" },
@@ -0,0 +1,331 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Per phase accounting, enabled by -P, and run statistics, enabled
+ * by -s.
+ *
+ * The interpreter tells which phase it is in with phase_enter(), and
+ * the hardware counters are read at each change and charged to the
+ * phase being left.  Phases nest: a field split done while printing
+ * is charged to split, then printing resumes.
+ *
+ * The wall clock time of each phase is always kept.  On x86 the
+ * counters are read in userland with rdpmc when the kernel allows it,
+ * else with read(2), which makes a run with -P slower but does not
+ * change the counts of the phases: the kernel part is excluded.
+ *
+ * The statistics are counters bumped unconditionally where the work
+ * is done, and allocations counted by call site in xmalloc.c.
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "awk.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__amd64__) || defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define	HAVE_RDPMC
+#endif
+
+struct pmc {
+	const char	*name;
+	uint32_t	 type;
+	uint64_t	 config;
+	int		 fd;
+	volatile void	*page;		/* perf_event_mmap_page, for rdpmc */
+	uint64_t	 last;		/* value at the last phase change */
+	uint64_t	 count[NPHASES];
+};
+
+#ifdef __linux__
+#define	PMC(n, t, c)	{ n, PERF_TYPE_##t, PERF_COUNT_##c, -1 }
+#else
+#define	PMC(n, t, c)	{ n, 0, 0, -1 }
+#endif
+
+struct pmc	pmcs[] = {
+	PMC("cycles",		HARDWARE, HW_CPU_CYCLES),
+	PMC("instructions",	HARDWARE, HW_INSTRUCTIONS),
+	PMC("branch-misses",	HARDWARE, HW_BRANCH_MISSES),
+	PMC("LLC-misses",	HARDWARE, HW_CACHE_MISSES),
+};
+
+const char *phasenames[NPHASES] = {
+	"other", "parse", "read", "split", "evaluate", "output",
+};
+
+struct stats	 stats;
+int		 phasing = 0;
+int		 pmcing = 0;		/* -P */
+int		 statsing = 0;		/* -s */
+int		 curphase = PH_NONE;
+uint64_t	 lastns;
+uint64_t	 phasens[NPHASES];
+
+uint64_t	 phase_ns(void);
+int		 pmc_open(struct pmc *);
+uint64_t	 pmc_read(struct pmc *);
+void		 phase_write(void);
+void		 stats_write(void);
+int		 asite_cmp(const void *, const void *);
+
+/*
+ * start keeping track of phases, with the counters if `counters',
+ * the report is written to stderr at exit
+ */
+void
+phase_init(int counters, int statistics)
+{
+	size_t i;
+	int n = 0;
+
+	pmcing = counters;
+	statsing = statistics;
+	for (i = 0; pmcing && i < nitems(pmcs); i++)
+		n += pmc_open(&pmcs[i]);
+	if (pmcing && n == 0)
+		warnx("no performance counters available");
+	for (i = 0; i < nitems(pmcs); i++)
+		if (pmcs[i].fd != -1)
+			pmcs[i].last = pmc_read(&pmcs[i]);
+	lastns = phase_ns();
+	phasing = 1;
+	atexit(phase_write);
+}
+
+uint64_t
+phase_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int
+pmc_open(struct pmc *p)
+{
+#ifdef __linux__
+	struct perf_event_attr attr;
+	void *pg;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = p->type;
+	attr.config = p->config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	p->fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (p->fd == -1)
+		return 0;
+	pg = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, p->fd, 0);
+	if (pg != MAP_FAILED)
+		p->page = pg;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+uint64_t
+pmc_read(struct pmc *p)
+{
+	uint64_t v;
+
+#if defined(__linux__) && defined(HAVE_RDPMC)
+	volatile struct perf_event_mmap_page *pg = p->page;
+	uint32_t seq, idx;
+	int64_t c;
+
+	if (pg != NULL && pg->cap_user_rdpmc) {
+		do {
+			seq = pg->lock;
+			__asm__ volatile("" ::: "memory");
+			idx = pg->index;
+			v = pg->offset;
+			if (idx != 0) {
+				c = __rdpmc(idx - 1);
+				c <<= 64 - pg->pmc_width;
+				c >>= 64 - pg->pmc_width;
+				v += c;
+			}
+			__asm__ volatile("" ::: "memory");
+		} while (pg->lock != seq);
+		if (idx != 0)
+			return v;
+	}
+#endif
+	if (read(p->fd, &v, sizeof(v)) != sizeof(v))
+		return p->last;
+	return v;
+}
+
+/*
+ * switch to phase `ph', returns the phase left
+ */
+int
+phase_enter(int ph)
+{
+	struct pmc *p;
+	uint64_t v;
+	int old = curphase;
+
+	if (ph == old)
+		return old;
+	v = phase_ns();
+	phasens[old] += v - lastns;
+	lastns = v;
+	for (p = pmcs; p < pmcs + nitems(pmcs); p++) {
+		if (p->fd == -1)
+			continue;
+		v = pmc_read(p);
+		p->count[old] += v - p->last;
+		p->last = v;
+	}
+	curphase = ph;
+	return old;
+}
+
+void
+phase_write(void)
+{
+	static const int order[] = {
+		PH_PARSE, PH_READ, PH_SPLIT, PH_EVAL, PH_OUTPUT, PH_NONE,
+	};
+	struct pmc *p, *cyc = &pmcs[0], *ins = &pmcs[1];
+	uint64_t total;
+	size_t i;
+
+	phase_enter(PH_NONE);
+	if (statsing)
+		stats_write();
+	fprintf(stderr, "%-14s", "");
+	for (i = 0; i < nitems(order); i++)
+		fprintf(stderr, " %13s", phasenames[order[i]]);
+	fprintf(stderr, " %13s\n", "total");
+	fprintf(stderr, "%-14s", "time (ms)");
+	total = 0;
+	for (i = 0; i < nitems(order); i++) {
+		total += phasens[order[i]];
+		fprintf(stderr, " %13.3f", phasens[order[i]] / 1e6);
+	}
+	fprintf(stderr, " %13.3f\n", total / 1e6);
+	if (!pmcing)
+		return;
+	for (p = pmcs; p < pmcs + nitems(pmcs); p++) {
+		fprintf(stderr, "%-14s", p->name);
+		total = 0;
+		for (i = 0; i < nitems(order); i++) {
+			total += p->count[order[i]];
+			if (p->fd == -1)
+				fprintf(stderr, " %13s", "-");
+			else
+				fprintf(stderr, " %13llu",
+				    (unsigned long long)p->count[order[i]]);
+		}
+		if (p->fd == -1)
+			fprintf(stderr, " %13s\n", "-");
+		else
+			fprintf(stderr, " %13llu\n", (unsigned long long)total);
+	}
+	if (cyc->fd == -1 || ins->fd == -1)
+		return;
+	fprintf(stderr, "%-14s", "IPC");
+	for (i = 0; i < nitems(order); i++) {
+		if (cyc->count[order[i]] == 0)
+			fprintf(stderr, " %13s", "-");
+		else
+			fprintf(stderr, " %13.2f", (double)ins->count[order[i]] /
+			    cyc->count[order[i]]);
+	}
+	fprintf(stderr, "\n");
+}
+
+void
+stats_write(void)
+{
+	struct asite *as, **v;
+	const char *file;
+	size_t i, n = 0;
+
+	fprintf(stderr, "records read        %14llu\n"
+	    "bytes read          %14llu\n"
+	    "fields split        %14llu\n"
+	    "fval_get parses     %14llu\n"
+	    "is_number calls     %14llu\n"
+	    "sval_get formats    %14llu\n"
+	    "record rebuilds     %14llu\n"
+	    "temporary cells     %14llu\n",
+	    (unsigned long long)stats.records,
+	    (unsigned long long)stats.bytes,
+	    (unsigned long long)stats.fields,
+	    (unsigned long long)stats.atof,
+	    (unsigned long long)stats.isnum,
+	    (unsigned long long)stats.fmtnum,
+	    (unsigned long long)stats.rebuilds,
+	    (unsigned long long)stats.temps);
+
+	for (as = asites; as != NULL; as = as->next)
+		n++;
+	/* one more for this call site */
+	v = xreallocarray(NULL, n + 1, sizeof(*v));
+	for (n = 0, as = asites; as != NULL; as = as->next)
+		v[n++] = as;
+	qsort(v, n, sizeof(*v), asite_cmp);
+	fprintf(stderr, "\nallocations by call site:\n"
+	    "%14s %14s  site\n", "count", "bytes");
+	for (i = 0; i < n; i++) {
+		if ((file = strrchr(v[i]->file, '/')) != NULL)
+			file++;
+		else
+			file = v[i]->file;
+		fprintf(stderr, "%14llu %14llu  %s:%d %s\n",
+		    (unsigned long long)v[i]->count,
+		    (unsigned long long)v[i]->bytes,
+		    file, v[i]->line, v[i]->fn);
+	}
+	free(v);
+	fprintf(stderr, "\n");
+}
+
+/* by decreasing number of bytes */
+int
+asite_cmp(const void *a, const void *b)
+{
+	const struct asite *x = *(const struct asite **)a;
+	const struct asite *y = *(const struct asite **)b;
+
+	if (x->bytes != y->bytes)
+		return x->bytes < y->bytes ? 1 : -1;
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return strcmp(x->file, y->file) ? strcmp(x->file, y->file) :
+	    x->line - y->line;
+}
@@ -0,0 +1,387 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Pipelined input, enabled by -t.
+ *
+ * A reader thread fills batches of whole records, a splitter thread
+ * cuts them into records and fields and tells which fields are numbers,
+ * and the interpreter takes the records of the prepared batches in
+ * order with pipe_get(), in place of record_get().
+ *
+ * The batches go around three single producer, single consumer rings:
+ * free -> reader -> splitter -> interpreter -> free.  The interpreter
+ * keeps the batch before the current one, the fields of the current
+ * record may still point into it.
+ *
+ * The helper threads do not touch the interpreter state, they only
+ * allocate with realloc(3) and report errors in the batch.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "awk.h"
+
+#define	NBATCH		8		/* batches in flight, a power of 2 */
+#define	BATCHSIZE	(256 * 1024)	/* initial size of a batch */
+#define	SPINS		1000		/* yields before sleeping */
+
+#define	PS_IDLE		0
+#define	PS_RUNNING	1
+#define	PS_DONE		2		/* end of input, threads joined */
+
+struct precord {
+	size_t		 off;		/* in buf, \0 terminated */
+	size_t		 len;
+	size_t		 field;		/* first field in fields */
+	int		 nf;
+};
+
+struct batch {
+	char		*buf;		/* whole records */
+	size_t		 bufsize;
+	size_t		 len;
+	char		*text;		/* the fields, \0 terminated */
+	size_t		 textsize;
+	struct precord	*recs;
+	size_t		 nrec;
+	size_t		 recsize;
+	struct pfield	*fields;
+	size_t		 nfield;
+	size_t		 fieldsize;
+	int		 eof;		/* last batch of the input */
+	int		 error;		/* errno of the reader or splitter */
+};
+
+struct ring {
+	_Alignas(64) atomic_size_t head;	/* next slot to take */
+	_Alignas(64) atomic_size_t tail;	/* next slot to fill */
+	struct batch	*slot[NBATCH];
+};
+
+int		 pipelining = 0;	/* -t */
+struct batch	 batches[NBATCH];
+struct ring	 freeq, readq, splitq;
+pthread_t	 reader, splitter;
+atomic_int	 stopping;
+int		 pstate = PS_IDLE;
+int		 pipefd;
+struct batch	*cur, *prev;		/* in use by the interpreter */
+size_t		 currec;
+
+void		 pipe_start(FILE *);
+void		*pipe_reader(void *);
+void		*pipe_splitter(void *);
+int		 pipe_fill(struct batch *, char **, size_t *, size_t *);
+int		 pipe_split(struct batch *);
+int		 pipe_grow(void *, size_t *, size_t, size_t);
+void		 ring_put(struct ring *, struct batch *);
+struct batch	*ring_get(struct ring *);
+
+/*
+ * load the next input record from the pipeline, 0 at the end
+ */
+int
+pipe_get(FILE *inf)
+{
+	struct precord *r;
+
+	if (pstate == PS_DONE)
+		return 0;
+	if (pstate == PS_IDLE)
+		pipe_start(inf);
+	while (cur == NULL || currec == cur->nrec) {
+		if (cur != NULL && cur->eof) {
+			pthread_join(reader, NULL);
+			pthread_join(splitter, NULL);
+			pstate = PS_DONE;
+			if (cur->error)
+				FATAL("read error on input: %s",
+				    strerror(cur->error));
+			return 0;
+		}
+		if (prev != NULL)
+			ring_put(&freeq, prev);
+		prev = cur;
+		cur = ring_get(&splitq);
+		currec = 0;
+		stats.bytes += cur->len;
+		stats.records += cur->nrec;
+		stats.fields += cur->nfield;
+		stats.isnum += cur->nfield;
+	}
+	r = &cur->recs[currec++];
+	record_load(cur->buf + r->off, r->len);
+	field_load(cur->text, cur->fields + r->field, r->nf);
+	return 1;
+}
+
+void
+pipe_start(FILE *inf)
+{
+	int i, error;
+
+	atomic_init(&freeq.head, 0);
+	atomic_init(&freeq.tail, 0);
+	atomic_init(&readq.head, 0);
+	atomic_init(&readq.tail, 0);
+	atomic_init(&splitq.head, 0);
+	atomic_init(&splitq.tail, 0);
+	for (i = 0; i < NBATCH; i++)
+		ring_put(&freeq, &batches[i]);
+	cur = prev = NULL;
+	currec = 0;
+	pipefd = fileno(inf);
+	atomic_store(&stopping, 0);
+	if ((error = pthread_create(&reader, NULL, pipe_reader, NULL)) != 0 ||
+	    (error = pthread_create(&splitter, NULL, pipe_splitter, NULL)) != 0)
+		FATAL("can't start the input threads: %s", strerror(error));
+	pstate = PS_RUNNING;
+}
+
+/*
+ * stop the threads, the rest of the input is lost
+ */
+void
+pipe_stop(void)
+{
+	if (pstate == PS_RUNNING) {
+		atomic_store(&stopping, 1);
+		/* the reader may be blocked in read(2) */
+		pthread_cancel(reader);
+		pthread_join(reader, NULL);
+		pthread_join(splitter, NULL);
+	}
+	pstate = PS_IDLE;
+	cur = prev = NULL;
+}
+
+void *
+pipe_reader(void *arg)
+{
+	static char *carry;
+	static size_t carrysize;
+	struct batch *b;
+	size_t clen = 0;
+
+	do {
+		if ((b = ring_get(&freeq)) == NULL)
+			break;
+		pipe_fill(b, &carry, &carrysize, &clen);
+		ring_put(&readq, b);
+	} while (!b->eof);
+	return NULL;
+}
+
+/*
+ * read whole records in b, starting with the clen bytes left in carry
+ * by the previous batch, and leave there the start of the last one
+ */
+int
+pipe_fill(struct batch *b, char **carry, size_t *carrysize, size_t *clen)
+{
+	char *nl;
+	ssize_t r;
+
+	b->len = 0;
+	b->eof = 0;
+	b->error = 0;
+	if (b->bufsize == 0 && pipe_grow(&b->buf, &b->bufsize, BATCHSIZE, 1))
+		goto nomem;
+	/* back from a long record, a failure to shrink is harmless */
+	if (b->bufsize > BATCHSIZE && *clen + 1 < BATCHSIZE)
+		pipe_grow(&b->buf, &b->bufsize, BATCHSIZE, 1);
+	if (*clen + 1 >= b->bufsize &&
+	    pipe_grow(&b->buf, &b->bufsize, *clen * 2, 1))
+		goto nomem;
+	if (*clen > 0)
+		memcpy(b->buf, *carry, *clen);
+	b->len = *clen;
+	*clen = 0;
+	for (;;) {
+		/* keep one byte to terminate a last record without separator */
+		while (b->len + 1 < b->bufsize) {
+			r = read(pipefd, b->buf + b->len, b->bufsize - b->len - 1);
+			if (r == -1 && errno == EINTR)
+				continue;
+			if (r == -1) {
+				b->error = errno;
+				b->eof = 1;
+				return -1;
+			}
+			if (r == 0) {
+				b->eof = 1;
+				return 0;
+			}
+			b->len += r;
+		}
+		if ((nl = memrchr(b->buf, '\n', b->len)) != NULL)
+			break;
+		/* a record longer than the batch */
+		if (pipe_grow(&b->buf, &b->bufsize, b->bufsize * 2, 1))
+			goto nomem;
+	}
+	nl++;
+	*clen = b->buf + b->len - nl;
+	if (*clen > *carrysize && pipe_grow(carry, carrysize, *clen, 1))
+		goto nomem;
+	memcpy(*carry, nl, *clen);
+	b->len = nl - b->buf;
+	return 0;
+  nomem:
+	b->error = ENOMEM;
+	b->eof = 1;
+	return -1;
+}
+
+void *
+pipe_splitter(void *arg)
+{
+	struct batch *b;
+
+	do {
+		if ((b = ring_get(&readq)) == NULL)
+			break;
+		if (pipe_split(b) == -1) {
+			b->error = ENOMEM;
+			b->eof = 1;
+		}
+		ring_put(&splitq, b);
+	} while (!b->eof);
+	return NULL;
+}
+
+/*
+ * cut b in records and fields, as field_from_record() does
+ */
+int
+pipe_split(struct batch *b)
+{
+	struct precord *rec;
+	struct pfield *f;
+	char *s, *nl, *end, *t;
+	size_t n;
+
+	b->nrec = b->nfield = 0;
+	/* the fields and their \0s take at most a byte more than b */
+	if (b->textsize < b->len + 1) {
+		n = b->textsize * 2 > b->len + 1 ? b->textsize * 2 : b->len + 1;
+		if (pipe_grow(&b->text, &b->textsize, n, 1))
+			return -1;
+	} else if (b->textsize > BATCHSIZE && b->textsize > 4 * (b->len + 1))
+		pipe_grow(&b->text, &b->textsize, b->len + 1, 1);
+	s = b->buf;
+	end = b->buf + b->len;
+	t = b->text;
+	while (s < end) {
+		if ((nl = memchr(s, '\n', end - s)) == NULL)
+			nl = end;
+		*nl = '\0';
+		if (b->nrec == b->recsize && pipe_grow(&b->recs, &b->recsize,
+		    b->recsize * 2 + 64, sizeof(*b->recs)))
+			return -1;
+		rec = &b->recs[b->nrec++];
+		rec->off = s - b->buf;
+		rec->len = nl - s;
+		rec->field = b->nfield;
+		rec->nf = 0;
+		for (;;) {
+			while (*s == ' ' || *s == '\t')
+				s++;
+			if (*s == '\0')
+				break;
+			if (b->nfield == b->fieldsize &&
+			    pipe_grow(&b->fields, &b->fieldsize,
+			    b->fieldsize * 2 + 256, sizeof(*b->fields)))
+				return -1;
+			f = &b->fields[b->nfield++];
+			f->off = t - b->text;
+			do
+				*t++ = *s++;
+			while (*s != ' ' && *s != '\t' && *s != '\0');
+			*t++ = '\0';
+			f->isnum = is_numval(b->text + f->off, &f->fval);
+			rec->nf++;
+		}
+		s = nl + 1;
+	}
+	return 0;
+}
+
+/*
+ * grow the array *pp of *sizep elements of size elsize to n elements
+ */
+int
+pipe_grow(void *pp, size_t *sizep, size_t n, size_t elsize)
+{
+	void *p;
+
+	if ((p = reallocarray(*(void **)pp, n, elsize)) == NULL)
+		return -1;
+	*(void **)pp = p;
+	*sizep = n;
+	return 0;
+}
+
+void
+ring_put(struct ring *r, struct batch *b)
+{
+	size_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	int spins = 0;
+
+	/* a ring holds all the batches, it is never full */
+	while (t - atomic_load_explicit(&r->head, memory_order_acquire) ==
+	    NBATCH) {
+		if (++spins > SPINS)
+			sched_yield();
+	}
+	r->slot[t % NBATCH] = b;
+	atomic_store_explicit(&r->tail, t + 1, memory_order_release);
+}
+
+/*
+ * take the next batch from r, waiting for one, NULL if stopping
+ */
+struct batch *
+ring_get(struct ring *r)
+{
+	static const struct timespec nap = { 0, 50000 };
+	size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+	struct batch *b;
+	int spins = 0;
+
+	while (atomic_load_explicit(&r->tail, memory_order_acquire) == h) {
+		if (atomic_load_explicit(&stopping, memory_order_relaxed))
+			return NULL;
+		if (++spins < SPINS)
+			sched_yield();
+		else
+			nanosleep(&nap, NULL);
+	}
+	b = r->slot[h % NBATCH];
+	atomic_store_explicit(&r->head, h + 1, memory_order_release);
+	return b;
+}
@@ -0,0 +1,399 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Profiler, enabled by -p.
+ *
+ * Every operator Node of the program gets its proc replaced by
+ * prof_call(), which counts and times the call of the original one,
+ * so nothing is spent when the profiler is off.  Time spent in the
+ * operands is subtracted to get the self time of a Node, which is
+ * then summed by source line.
+ */
+
+#include <err.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "awk.h"
+#include "ytab.h"
+
+#if defined(__amd64__) || defined(__i386__)
+#include <x86intrin.h>
+#define	prof_cycles()	__rdtsc()
+#else
+#define	prof_cycles()	0
+#endif
+
+struct pnode {
+	Node		*node;
+	Cell		*(*proc)(Node **, int);	/* the original one */
+	uint64_t	 count;
+	uint64_t	 ns, cyc;		/* including operands */
+	uint64_t	 selfns, selfcyc;
+	uint64_t	 matched;		/* PASTAT: times the pattern held */
+};
+
+struct pframe {
+	uint64_t	 childns, childcyc;	/* spent in operands */
+};
+
+/* record latencies: 8 buckets per power of 2 */
+#define	PSUB		3
+#define	PBUCKETS	(16 + 60 * 8)
+
+int		 profiling = 0;
+FILE		*proffp;
+const char	*pprog;			/* program text, if on the command line */
+struct pnode	*pnodes;
+int		 npnodes, pnodessize;
+int		*phash;			/* pnodes index + 1, by Node */
+int		 phashsize;		/* a power of 2 */
+struct pframe	*pframes;
+int		 npframes, pframessize;
+uint64_t	 platency[PBUCKETS];
+uint64_t	 precords, pstart;
+
+void		 prof_walk(Node *);
+struct pnode	*prof_find(Node *);
+uint64_t	 prof_ns(void);
+int		 prof_bucket(uint64_t);
+uint64_t	 prof_percentile(double);
+void		 prof_write(void);
+char		**prof_source(int *);
+
+/*
+ * start profiling the program rooted at `root', to the file `path'
+ */
+void
+prof_init(const char *path, Node *root, const char *prog)
+{
+	int i;
+
+	if ((proffp = fopen(path, "w")) == NULL)
+		err(1, "can't open profile %s", path);
+	pprog = prog;
+	for (i = 0; i < root->nargs; i++)
+		prof_walk(root->narg[i]);
+	phashsize = 16;
+	while (phashsize < 2 * npnodes)
+		phashsize *= 2;
+	phash = xcalloc(phashsize, sizeof(int));
+	for (i = 0; i < npnodes; i++) {
+		uint64_t h = hash(&pnodes[i].node, sizeof(Node *));
+
+		while (phash[h & (phashsize - 1)] != 0)
+			h++;
+		phash[h & (phashsize - 1)] = i + 1;
+	}
+	profiling = 1;
+	pstart = prof_ns();
+	atexit(prof_write);
+}
+
+void
+prof_walk(Node *n)
+{
+	struct pnode *p;
+	int i;
+
+	for (; n != NULL; n = n->nnext) {
+		if (n->ntype == NVALUE || n->proc == prof_call)
+			continue;
+		if (npnodes == pnodessize) {
+			pnodessize = pnodessize ? 2 * pnodessize : 64;
+			pnodes = xreallocarray(pnodes, pnodessize,
+			    sizeof(*pnodes));
+		}
+		p = &pnodes[npnodes++];
+		memset(p, 0, sizeof(*p));
+		p->node = n;
+		p->proc = n->nobj == PASTAT ? prof_pastat : n->proc;
+		n->proc = prof_call;
+		for (i = 0; i < n->nargs; i++)
+			prof_walk(n->narg[i]);
+	}
+}
+
+struct pnode *
+prof_find(Node *n)
+{
+	uint64_t h = hash(&n, sizeof(Node *));
+	int i;
+
+	for (;; h++) {
+		i = phash[h & (phashsize - 1)];
+		if (pnodes[i - 1].node == n)
+			return &pnodes[i - 1];
+	}
+}
+
+uint64_t
+prof_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * call the original proc of a Node, accounting for it
+ */
+Cell *
+prof_call(Node **a, int n)
+{
+	struct pnode *p;
+	struct pframe *f;
+	uint64_t ns, cyc;
+	Cell *x;
+
+	p = prof_find((Node *)((char *)a - offsetof(Node, narg)));
+	if (npframes == pframessize) {
+		pframessize = pframessize ? 2 * pframessize : 64;
+		pframes = xreallocarray(pframes, pframessize, sizeof(*pframes));
+	}
+	f = &pframes[npframes++];
+	f->childns = f->childcyc = 0;
+	ns = prof_ns();
+	cyc = prof_cycles();
+	x = p->proc(a, n);
+	cyc = prof_cycles() - cyc;
+	ns = prof_ns() - ns;
+	f = &pframes[--npframes];
+	p->count++;
+	p->ns += ns;
+	p->cyc += cyc;
+	p->selfns += ns - f->childns;
+	p->selfcyc += cyc - f->childcyc;
+	if (npframes > 0) {
+		pframes[npframes - 1].childns += ns;
+		pframes[npframes - 1].childcyc += cyc;
+	}
+	return x;
+}
+
+/*
+ * f_pastat(), counting the matches of the pattern
+ */
+Cell *
+prof_pastat(Node **a, int n)
+{
+	extern Cell *True;
+	struct pnode *p;
+	Cell *x;
+
+	p = prof_find((Node *)((char *)a - offsetof(Node, narg)));
+	if (a[0] == NULL) {
+		p->matched++;
+		return execute(a[1]);
+	}
+	x = execute(a[0]);
+	if (x == True) {
+		p->matched++;
+		tcell_put(x);
+		x = execute(a[1]);
+	}
+	return x;
+}
+
+/*
+ * main loop of f_program(), timing each record
+ */
+void
+prof_main(FILE *fp, Node *rules)
+{
+	extern char *record;
+	uint64_t t;
+
+	for (;;) {
+		t = prof_ns();
+		if ((nrlast != 0 && *NR >= nrlast) || record_get(fp) <= 0)
+			break;
+		if (prefilter_match(record, reclen))
+			tcell_put(execute(rules));
+		platency[prof_bucket(prof_ns() - t)]++;
+		precords++;
+	}
+}
+
+int
+prof_bucket(uint64_t v)
+{
+	int e;
+
+	if (v < 16)
+		return v;
+	e = 63 - __builtin_clzll(v);
+	return 16 + (e - 4) * 8 + ((v >> (e - PSUB)) & 7);
+}
+
+/*
+ * lower bound of the record latency under which a fraction q are
+ */
+uint64_t
+prof_percentile(double q)
+{
+	uint64_t n = 0, want;
+	int i, e;
+
+	if (precords == 0)
+		return 0;
+	want = q * precords;
+	if (want >= precords)
+		want = precords - 1;
+	for (i = 0; i < PBUCKETS; i++) {
+		n += platency[i];
+		if (n > want)
+			break;
+	}
+	if (i < 16)
+		return i;
+	e = (i - 16) / 8 + 4;
+	return (uint64_t)(8 + (i - 16) % 8) << (e - PSUB);
+}
+
+/*
+ * lines of the program, if it comes from the command line or one file
+ */
+char **
+prof_source(int *nlines)
+{
+	extern char *pfile[];
+	extern int npfile;
+	char **lines = NULL, *s, *p;
+	size_t sz = 0;
+	FILE *fp;
+	int n = 0;
+
+	*nlines = 0;
+	if (pprog != NULL)
+		s = xstrdup(pprog);
+	else if (npfile == 1 && strcmp(pfile[0], "-") != 0 &&
+	    (fp = fopen(pfile[0], "r")) != NULL) {
+		s = NULL;
+		if (getdelim(&s, &sz, '\0', fp) == -1) {
+			free(s);
+			s = NULL;
+		}
+		fclose(fp);
+		if (s == NULL)
+			return NULL;
+	} else
+		return NULL;
+	for (p = s; p != NULL; n++) {
+		lines = xreallocarray(lines, n + 2, sizeof(char *));
+		lines[n + 1] = p;
+		if ((p = strchr(p, '\n')) != NULL)
+			*p++ = '\0';
+	}
+	*nlines = n;
+	return lines;		/* lines[1] is line 1 */
+}
+
+int
+prof_cmpline(const void *a, const void *b)
+{
+	const struct pnode *x = a, *y = b;
+
+	if (x->node == NULL || y->node == NULL)
+		return (x->node == NULL) - (y->node == NULL);
+	if (x->selfns != y->selfns)
+		return x->selfns < y->selfns ? 1 : -1;
+	return x->node->lineno - y->node->lineno;
+}
+
+void
+prof_write(void)
+{
+	struct pnode *p, *lines;
+	uint64_t total = 0;
+	char **src;
+	int i, l, maxline = 0, nsrc, rule = 0;
+	FILE *fp = proffp;
+
+	for (i = 0; i < npnodes; i++) {
+		total += pnodes[i].selfns;
+		if (pnodes[i].node->lineno > maxline)
+			maxline = pnodes[i].node->lineno;
+	}
+	fprintf(fp, "records %llu, %.3f s\n", (unsigned long long)precords,
+	    (prof_ns() - pstart) / 1e9);
+
+	/* sum Nodes by line, in a pnode whose node is any of the line */
+	lines = xcalloc(maxline + 1, sizeof(*lines));
+	for (i = 0; i < npnodes; i++) {
+		p = &lines[pnodes[i].node->lineno];
+		p->node = pnodes[i].node;
+		if (pnodes[i].count > p->count)
+			p->count = pnodes[i].count;
+		p->selfns += pnodes[i].selfns;
+		p->selfcyc += pnodes[i].selfcyc;
+	}
+	qsort(lines, maxline + 1, sizeof(*lines), prof_cmpline);
+	src = prof_source(&nsrc);
+	fprintf(fp, "\nlines by self time:\n");
+	fprintf(fp, "%6s %12s %12s %6s %12s  %s\n",
+	    "line", "count", "ms", "%", "Mcycles", "source");
+	for (i = 0; i <= maxline && lines[i].node != NULL; i++) {
+		p = &lines[i];
+		l = p->node->lineno;
+		fprintf(fp, "%6d %12llu %12.3f %6.2f %12.3f  %s\n", l,
+		    (unsigned long long)p->count, p->selfns / 1e6,
+		    total ? 100.0 * p->selfns / total : 0.0,
+		    p->selfcyc / 1e6, l >= 1 && l <= nsrc ? src[l] : "");
+	}
+
+	fprintf(fp, "\nrules:\n");
+	fprintf(fp, "%6s %6s %12s %12s %7s %12s\n",
+	    "rule", "line", "evaluated", "matched", "rate", "ms");
+	for (p = pnodes; p < pnodes + npnodes; p++) {
+		if (p->node->nobj != PASTAT)
+			continue;
+		fprintf(fp, "%6d %6d %12llu %12llu %6.2f%% %12.3f\n", ++rule,
+		    p->node->lineno, (unsigned long long)p->count,
+		    (unsigned long long)p->matched,
+		    p->count ? 100.0 * p->matched / p->count : 0.0,
+		    p->ns / 1e6);
+	}
+
+	fprintf(fp, "\nrecord latency (ns):\n");
+	fprintf(fp, "p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu\n",
+	    (unsigned long long)prof_percentile(0.5),
+	    (unsigned long long)prof_percentile(0.9),
+	    (unsigned long long)prof_percentile(0.99),
+	    (unsigned long long)prof_percentile(0.999),
+	    (unsigned long long)prof_percentile(1.0));
+
+	fprintf(fp, "\nnodes by self time:\n");
+	fprintf(fp, "%6s %-10s %12s %12s %12s\n",
+	    "line", "op", "count", "ms", "Mcycles");
+	qsort(pnodes, npnodes, sizeof(*pnodes), prof_cmpline);
+	for (p = pnodes; p < pnodes + npnodes; p++) {
+		if (p->count == 0)
+			continue;
+		fprintf(fp, "%6d %-10s %12llu %12.3f %12.3f\n",
+		    p->node->lineno, tokname(p->node->nobj),
+		    (unsigned long long)p->count, p->selfns / 1e6,
+		    p->selfcyc / 1e6);
+	}
+	fclose(fp);
+}
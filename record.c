@@ -23,10 +23,15 @@ ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
 THIS SOFTWARE.
 ****************************************************************/
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -34,13 +39,19 @@ THIS SOFTWARE.
 #include "awk.h"
 #include "ytab.h"
 
-#define	RECSIZE	(8 * 1024)	/* sets limit on records, fields, etc., etc. */
+#define	IBUFSIZE (128 * 1024)	/* initial size of the input buffer */
+#define	SHRINKRECS	256	/* short records before a buffer shrinks */
 
 char	*file	= "";
 char	*record;		/* points to $0 */
 int	recsize	= RECSIZE;
+size_t	reclen;			/* length of $0 as read */
+int	recsmall;		/* short records in a row, for record_fit() */
 char	*fields;
 int	fieldssize = RECSIZE;
+int	fieldssmall;
+int	maxrec = 0;		/* -m, longest record, 0 for no limit */
+int	cutc = -1;		/* byte of ibuf replaced by the \0 of a cut */
 
 Cell	*nrloc;		/* NR */
 double	*NR;		/* number of current record */
@@ -58,15 +69,38 @@ int	donerec;	/* 1 if `record' is valid (no flds have changed) */
 
 int	lastfld	= 0;	/* last used field */
 
-static Cell dollar0 = { CREC, NULL, "", 0.0, STR|DONTFREE };
-static Cell dollar1 = { CFLD, NULL, "", 0.0, STR|DONTFREE };
+char			*loadbase;	/* fields split elsewhere, */
+const struct pfield	*loadpf;	/* see field_load() */
+int			 loadn;
+int			 loaded;	/* 1 if they are the fields of $0 */
+
+char	*ibuf;		/* input buffer */
+size_t	 ibufsize;
+char	*ipos;		/* first unread byte of ibuf */
+char	*iend;		/* end of valid data in ibuf */
+int	 ieof;		/* 1 if end of input has been reached */
+off_t	 ileft = -1;	/* bytes left to read, -1 for all */
+off_t	 ioff;		/* where to read them, see record_range() */
+int	 recdirty;	/* 1 if $0 or a field was assigned */
+#define	NPASSIOV	1024
+struct iovec passiov[NPASSIOV];	/* records of ibuf to write as is */
+int	 npassiov;
+
+static Cell dollar0 = { CREC, STR|DONTFREE, 0, 0.0, "" };
+static Cell dollar1 = { CFLD, STR|DONTFREE, 0, 0.0, "" };
 
 void		 field_alloc(int, int);
 void		 field_realloc(int n);
 void		 field_purge(int, int);
 void		 field_from_record(void);
+void		 field_fromload(void);
 void		 record_build(void);
-int		 record_read(char **buf, int *bufsize, FILE *inf);
+void		 record_fit(char **, int *, int, int *, const char *);
+void		 input_fill(FILE *);
+int		 record_scan(FILE *, char **, size_t *);
+char		*record_cut(void);
+void		 record_uncut(void);
+size_t		 nlcount(const char *, size_t);
 
 void
 record_init(void)
@@ -76,79 +110,516 @@ record_init(void)
 	*record = '\0';
 
 	fieldssize = RECSIZE;
-	fields = xmalloc(fieldssize+1);
+	fields = xmalloc(fieldssize);
+
+	ibufsize = IBUFSIZE;
+	ibuf = xmalloc(ibufsize);
+	ipos = iend = ibuf;
+	ieof = 0;
 
 	fldtab = xcalloc(nfields+1, sizeof(Cell *));
 	fldtab[0] = xmalloc(sizeof(Cell));
 	*fldtab[0] = dollar0;
 	fldtab[0]->sval = record;
-	fldtab[0]->nval = xstrdup("0");
 	field_alloc(1, nfields);
 
+	record_symtab();
+}
+
+/*
+ * enter the variables of the record in the symbol table
+ */
+void
+record_symtab(void)
+{
 	nfloc = symtab_set("NF", "", 0.0, NUM);
 	NF = &nfloc->fval;
 	nrloc = symtab_set("NR", "", 0.0, NUM);
 	NR = &nrloc->fval;
 }
 
+/*
+ * NF of the fields split for another symbol table
+ */
+void
+record_sync(void)
+{
+	if (donefld)
+		fval_set(nfloc, (double) lastfld);
+}
+
+/*
+ * forget the input and the current record, for a new input
+ */
+void
+record_reset(void)
+{
+	pipe_stop();
+	uring_reset();
+	ipos = iend = ibuf;
+	ieof = 0;
+	ileft = -1;
+	cutc = -1;
+	npassiov = 0;		/* output of an aborted run */
+	tmp_reset();
+	cell_free(fldtab[0]);
+	*record = '\0';
+	fldtab[0]->sval = record;
+	fldtab[0]->tval = STR | DONTFREE;
+	donefld = 0;
+	donerec = 1;
+	loaded = 0;
+}
+
 /*
  * get next input record
  */
 int
 record_get(FILE *infile)
-{			/* note: cares whether buf == record */
-	char *buf = record;
-	int c, bufsize = recsize, savebufsize = recsize;
-	unsigned char saveb0;
+{
+	char *r;
+	size_t len;
+
+	if (pipelining) {
+		if (pipe_get(infile))
+			return 1;
+	} else if (record_next(infile, &r, &len)) {
+		record_load(r, len);
+		return 1;
+	}
+	donefld = 0;
+	donerec = 1;
+	loaded = 0;
+	return 0;	/* true end of file */
+}
 
+/*
+ * make r[0..len-1] the next record
+ */
+void
+record_load(const char *r, size_t len)
+{
+	record_set(r, len);
+	fval_set(nrloc, nrloc->fval+1);
+}
+
+/*
+ * make r[0..len-1] the current record, without counting it
+ */
+void
+record_set(const char *r, size_t len)
+{
+	recdirty = 0;
 	donefld = 0;
 	donerec = 1;
-	saveb0 = buf[0];
-	buf[0] = 0;
-	c = record_read(&buf, &bufsize, infile);
-	if (c != 0 || buf[0] != '\0') {	/* normal record */
-		cell_free(fldtab[0]);
-		fldtab[0]->sval = buf;	/* buf == record */
-		fldtab[0]->tval = STR | DONTFREE;
-		if (is_number(fldtab[0]->sval)) {
-			fldtab[0]->fval = atof(fldtab[0]->sval);
-			fldtab[0]->tval |= NUM;
+	loaded = 0;
+	tmp_reset();
+	if (len >= INT_MAX)
+		FATAL("record `%.30s...' is too long", r);
+	record_fit(&record, &recsize, len+1, &recsmall, "record_load");
+	memcpy(record, r, len+1);
+	reclen = len;
+	   DPRINTF("readrec saw <%s>\n", record);
+	cell_free(fldtab[0]);
+	fldtab[0]->sval = record;
+	fldtab[0]->tval = STR | DONTFREE;
+	if (is_number(fldtab[0]->sval)) {
+		fldtab[0]->fval = atof(fldtab[0]->sval);
+		fldtab[0]->tval |= NUM;
+	}
+}
+
+/*
+ * make *pbuf of *psiz bytes hold n bytes, without keeping its content
+ *
+ * like xadjbuf() it at least doubles, and it is halved after SHRINKRECS
+ * records in a row that fit in a quarter of it, so that a single long
+ * record does not keep its memory for the rest of the input.
+ */
+void
+record_fit(char **pbuf, int *psiz, int n, int *nsmall, const char *whatrtn)
+{
+	if (n > *psiz) {
+		xadjbuf(pbuf, psiz, n, RECSIZE, NULL, whatrtn);
+		*nsmall = 0;
+	} else if (*psiz > RECSIZE && n < *psiz / 4) {
+		if (++*nsmall < SHRINKRECS)
+			return;
+		*psiz = *psiz / 2 > RECSIZE ? *psiz / 2 : RECSIZE;
+		*pbuf = xrealloc(*pbuf, *psiz);
+		*nsmall = 0;
+		   DPRINTF("shrink %s: %d\n", whatrtn, *psiz);
+	} else
+		*nsmall = 0;
+}
+
+/*
+ * skip the next input record, only counting it
+ */
+int
+record_skip(FILE *infile)
+{
+	char *r;
+	size_t len;
+
+	if (record_next(infile, &r, &len) == 0)
+		return 0;
+	fval_set(nrloc, nrloc->fval+1);
+	return 1;
+}
+
+/*
+ * count, without reading them, all the remaining input records
+ */
+void
+record_count(FILE *infile)
+{
+	double n = 0;
+
+	if (maxrec > 0) {
+		/* the pieces of long records count */
+		while (record_skip(infile))
+			;
+		return;
+	}
+	for (;;) {
+		n += nlcount(ipos, iend - ipos);
+		if (ieof)
+			break;
+		/* only remember if a record is pending */
+		if (iend > ipos && iend[-1] != '\n')
+			ipos = iend - 1;
+		else
+			ipos = iend;
+		input_fill(infile);
+	}
+	if (iend > ipos && iend[-1] != '\n')
+		n++;		/* last record without separator */
+	ipos = iend;
+	stats.records += n;
+	fval_set(nrloc, nrloc->fval+n);
+}
+
+/*
+ * skip the records up to record nr, only counting them
+ *
+ * if the input has an index and nothing has been read yet, the blocks
+ * before the one holding record nr+1 are not read at all.
+ */
+void
+record_skipto(FILE *inf, double nr)
+{
+	double n = *NR, before;
+	char *nl;
+	off_t off;
+
+	if (maxrec > 0) {
+		/* the pieces of long records count, as NR, by record_skip() */
+		while (*NR < nr && record_skip(inf))
+			;
+		return;
+	}
+	if (n == 0 && ileft == -1 && ipos == ibuf && iend == ibuf && !ieof &&
+	    index_find(nr, &off, &before) &&
+	    lseek(fileno(inf), off, SEEK_SET) != -1) {
+		uring_reset();
+		   DPRINTF("skipto %.0f: %.0f records before offset %lld\n", nr,
+		       before, (long long)off);
+		stats.records += before;
+		n = before;
+	}
+	while (n < nr) {
+		if ((nl = memchr(ipos, '\n', iend - ipos)) != NULL) {
+			ipos = nl + 1;
+			n++;
+			stats.records++;
+			continue;
 		}
-		fval_set(nrloc, nrloc->fval+1);
-		record = buf;
-		recsize = bufsize;
-		return 1;
+		if (ieof) {
+			if (ipos < iend) {
+				/* last record without separator */
+				ipos = iend;
+				n++;
+				stats.records++;
+			}
+			break;
+		}
+		input_fill(inf);
 	}
-	buf[0] = saveb0;
-	record = buf;
-	recsize = savebufsize;
-	return 0;	/* true end of file */
+	fval_set(nrloc, n);
 }
 
 /*
- * read one record into buf
+ * read only the records from byte start to end of the input, with NR
+ * set to nr, the number of records before them, counted here if -1
+ *
+ * the input is read with pread(2): the file offset may be shared.
+ */
+void
+record_range(FILE *inf, off_t start, off_t end, double nr)
+{
+	off_t off;
+	size_t want;
+	ssize_t r;
+	double n = 0;
+
+	for (off = 0; nr == -1 && off < start; off += r) {
+		want = ibufsize;
+		if (want > start - off)
+			want = start - off;
+		r = pread(fileno(inf), ibuf, want, off);
+		if (r == -1 && errno == EINTR) {
+			r = 0;
+			continue;
+		}
+		if (r <= 0)
+			FATAL("read error on input");
+		n += nlcount(ibuf, r);
+	}
+	ipos = iend = ibuf;
+	ieof = 0;
+	cutc = -1;
+	ioff = start;
+	ileft = end - start;
+	fval_set(nrloc, nr == -1 ? n : nr);
+}
+
+/*
+ * count the newlines in s[0..n-1], a word at a time
  */
+size_t
+nlcount(const char *s, size_t n)
+{
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t high = 0x7f7f7f7f7f7f7f7fULL;
+	uint64_t w, t;
+	size_t c = 0;
+
+	for (; n >= sizeof(w); s += sizeof(w), n -= sizeof(w)) {
+		memcpy(&w, s, sizeof(w));
+		w ^= ones * '\n';
+		/* high bit set in each byte of t that is zero in w */
+		t = ~(((w & high) + high) | w | high);
+		c += __builtin_popcountll(t);
+	}
+	for (; n > 0; s++, n--)
+		c += (*s == '\n');
+	return c;
+}
+
+/*
+ * make room at the end of the input buffer and read more data
+ *
+ * the unread part is moved to the start of ibuf, so pointers into
+ * it are invalidated.
+ */
+void
+input_fill(FILE *inf)
+{
+	size_t n = iend - ipos, want;
+	ssize_t r;
+
+	record_flush();
+	if (ipos != ibuf) {
+		memmove(ibuf, ipos, n);
+		ipos = ibuf;
+		iend = ibuf + n;
+	}
+	if (n + 1 >= ibufsize) {
+		ibufsize *= 2;
+		ibuf = xrealloc(ibuf, ibufsize);
+		ipos = ibuf;
+		iend = ibuf + n;
+	} else if (ibufsize > IBUFSIZE && n < ibufsize / 4) {
+		/* back from a long record */
+		ibufsize /= 2;
+		ibuf = xrealloc(ibuf, ibufsize);
+		ipos = ibuf;
+		iend = ibuf + n;
+	}
+	/* keep one byte to terminate a last record without separator */
+	want = ibufsize - n - 1;
+	if (ileft != -1 && want > ileft)
+		want = ileft;
+	for (;;) {
+		if (ileft != -1)
+			r = pread(fileno(inf), iend, want, ioff);
+		else if (uringing)
+			r = uring_read(fileno(inf), iend, want);
+		else
+			r = read(fileno(inf), iend, want);
+		if (r != -1)
+			break;
+		if (errno != EINTR)
+			FATAL("read error on input");
+	}
+	if (r == 0)
+		ieof = 1;
+	if (ileft != -1) {
+		ileft -= r;
+		ioff += r;
+	}
+	iend += r;
+	stats.bytes += r;
+}
+
+/*
+ * get the next input record, without copying it
+ *
+ * on return *rp points to the record inside the input buffer, with
+ * its separator replaced by a \0.  It is valid until the next call.
+ */
+int
+record_next(FILE *inf, char **rp, size_t *lenp)
+{
+	int ph, r;
+
+	if (!phasing)
+		return record_scan(inf, rp, lenp);
+	ph = phase_enter(PH_READ);
+	r = record_scan(inf, rp, lenp);
+	phase_enter(ph);
+	return r;
+}
+
+/* record_next(), without the phase accounting */
 int
-record_read(char **pbuf, int *pbufsize, FILE *inf)
+record_scan(FILE *inf, char **rp, size_t *lenp)
 {
-	int c, sep = '\n';
-	char *rr, *buf = *pbuf;
-	int bufsize = *pbufsize;
+	char *nl;
+	size_t off = 0;
 
-	rr = buf;
-	while ((c=getc(inf)) != sep && c != EOF) {
-		if (rr-buf+1 > bufsize) {
-			xadjbuf(&buf, &bufsize, 1+rr-buf, recsize, &rr,
-			    "record_read 1");
+	record_uncut();
+	for (;;) {
+		nl = memchr(ipos + off, '\n', iend - ipos - off);
+		if (nl != NULL)
+			break;
+		if (ieof) {
+			if (ipos == iend)
+				return 0;
+			nl = iend;
+			break;
 		}
-		*rr++ = c;
+		/* no need to read the rest of a record that is cut */
+		if (maxrec > 0 && iend - ipos > maxrec)
+			break;
+		off = iend - ipos;
+		input_fill(inf);
+	}
+	if (maxrec > 0 && (nl == NULL || nl - ipos > maxrec))
+		nl = record_cut();
+	*rp = ipos;
+	*lenp = nl - ipos;
+	if (cutc != -1)
+		ipos = nl;
+	else
+		ipos = (nl == iend) ? iend : nl + 1;
+	*nl = '\0';
+	stats.records++;
+	return 1;
+}
+
+/*
+ * end of the first piece of a record longer than maxrec: as many whole
+ * fields as fit, or maxrec bytes of a longer field
+ *
+ * the rest of the record is the next one, so a long record is read as
+ * pieces and never held whole.
+ */
+char *
+record_cut(void)
+{
+	char *p;
+
+	for (p = ipos + maxrec; p > ipos; p--) {
+		if (*p == ' ' || *p == '\t')
+			return p;
 	}
-	xadjbuf(&buf, &bufsize, 1+rr-buf, recsize, &rr, "record_read 3");
-	*rr = 0;
-	   DPRINTF("readrec saw <%s>, returns %d\n", buf, c == EOF && rr == buf ? 0 : 1);
-	*pbuf = buf;
-	*pbufsize = bufsize;
-	return c == EOF && rr == buf ? 0 : 1;
+	/* the \0 will take the place of the next byte */
+	cutc = (unsigned char)ipos[maxrec];
+	return ipos + maxrec;
+}
+
+/*
+ * put back the byte of the next record replaced by record_cut()
+ */
+void
+record_uncut(void)
+{
+	if (cutc != -1) {
+		*ipos = cutc;
+		cutc = -1;
+	}
+}
+
+/*
+ * write record r, as returned by record_next(), and its separator to
+ * the output as print($0) would, without copying it
+ *
+ * the records are gathered and written by record_flush(), adjacent
+ * ones as a single range.
+ */
+void
+record_pass(char *r, size_t len)
+{
+	static int registered;
+	struct iovec *iov;
+
+	r[len] = '\n';
+	iov = npassiov > 0 ? &passiov[npassiov - 1] : NULL;
+	if (iov != NULL && (char *)iov->iov_base + iov->iov_len == r)
+		iov->iov_len += len + 1;
+	else {
+		if (npassiov == NPASSIOV)
+			record_flush();
+		passiov[npassiov].iov_base = r;
+		passiov[npassiov].iov_len = len + 1;
+		npassiov++;
+	}
+	if (!registered) {
+		/* for the output before a fatal error */
+		atexit(record_flush);
+		registered = 1;
+	}
+	/* the \n is in place of a byte of the next record */
+	if (cutc != -1)
+		record_flush();
+}
+
+/*
+ * write the records given to record_pass(), before ibuf changes or
+ * anything else is written
+ */
+void
+record_flush(void)
+{
+	extern FILE *outfile;
+	struct iovec *iov = passiov;
+	ssize_t w;
+	int n = npassiov, ph = PH_NONE;
+
+	if (n == 0)
+		return;
+	npassiov = 0;
+	if (phasing)
+		ph = phase_enter(PH_OUTPUT);
+	fflush(outfile);
+	while (n > 0) {
+		if ((w = writev(fileno(outfile), iov, n)) == -1) {
+			if (errno == EINTR)
+				continue;
+			FATAL("write error");
+		}
+		/* skip what has been written */
+		for (; n > 0 && w >= (ssize_t)iov->iov_len; iov++, n--)
+			w -= iov->iov_len;
+		if (n > 0) {
+			iov->iov_base = (char *)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+	if (phasing)
+		phase_enter(ph);
 }
 
 /*
@@ -167,15 +638,16 @@ field_from_record(void)
 
 	if (donefld)
 		return;
+	if (loaded) {
+		field_fromload();
+		return;
+	}
 	if (!isstr(fldtab[0]))
 		sval_get(fldtab[0]);
 	r = fldtab[0]->sval;
 	n = strlen(r);
-	if (n > fieldssize) {
-		xfree(fields);
-		fields = xmalloc(n+2); /* possibly 2 final \0s */
-		fieldssize = n;
-	}
+	/* possibly 2 final \0s */
+	record_fit(&fields, &fieldssize, n+2, &fieldssmall, "field_from_record");
 	fr = fields;
 	i = 0;	/* number of fields accumulated here */
 	for (i = 0; ; ) {
@@ -199,6 +671,7 @@ field_from_record(void)
 		FATAL("record `%.30s...' has too many fields; can't happen", r);
 	field_purge(i+1, lastfld);	/* clean out junk from previous record */
 	lastfld = i;
+	stats.fields += i;
 	donefld = 1;
 	for (j = 1; j <= lastfld; j++) {
 		p = fldtab[j];
@@ -211,16 +684,65 @@ field_from_record(void)
 	if (debug) {
 		for (j = 0; j <= lastfld; j++) {
 			p = fldtab[j];
-			printf("field %d (%s): |%s|\n", j, p->nval, p->sval);
+			printf("field %d: |%s|\n", j, p->sval);
 		}
 	}
 }
 
+/*
+ * make the n fields of pf, split elsewhere, the fields of the record
+ *
+ * their text is in base, which must stay valid as long as the record.
+ * As when split here, they and NF are only set once a field is used.
+ */
+void
+field_load(char *base, const struct pfield *pf, int n)
+{
+	loadbase = base;
+	loadpf = pf;
+	loadn = n;
+	loaded = 1;
+}
+
+void
+field_fromload(void)
+{
+	const struct pfield *pf = loadpf;
+	Cell *p;
+	int i, n = loadn;
+
+	if (n > nfields)
+		field_realloc(n);
+	for (i = 1; i <= n; i++, pf++) {
+		p = fldtab[i];
+		cell_free(p);
+		p->sval = loadbase + pf->off;
+		p->tval = STR | DONTFREE;
+		if (pf->isnum) {
+			p->fval = pf->fval;
+			p->tval |= NUM;
+		}
+	}
+	field_purge(n+1, lastfld);
+	lastfld = n;
+	donefld = 1;
+	loaded = 0;
+	fval_set(nfloc, (double) n);
+}
+
 void
 record_cache(Cell *x)
 {
-	if (isfld(x))
-		field_from_record();
+	int ph;
+
+	if (isfld(x)) {
+		if (phasing) {
+			ph = phase_enter(PH_SPLIT);
+			field_from_record();
+			phase_enter(ph);
+		} else
+			field_from_record();
+	}
 	if (isrec(x)) {
 		record_build();
 	}
@@ -230,11 +752,15 @@ record_cache(Cell *x)
 void
 record_invalidate(Cell *x)
 {
-	if (isfld(x))
+	if (isfld(x)) {
 		donerec = 0;	/* mark $0 invalid */
+		recdirty = 1;
+	}
 	if (isrec(x)) {
 		donefld = 0;	/* mark $1... invalid */
+		loaded = 0;
 		donerec = 1;
+		recdirty = 1;
 	}
 }
 
@@ -287,19 +813,19 @@ field_get(int n)
 }
 
 /*
- * create $n1..$n2 inclusive
+ * create $n1..$n2 inclusive, contiguously
  */
 void
 field_alloc(int n1, int n2)
 {
-	char temp[50];
+	Cell *c;
 	int i;
 
-	for (i = n1; i <= n2; i++) {
-		fldtab[i] = xmalloc(sizeof (struct Cell));
-		*fldtab[i] = dollar1;
-		snprintf(temp, sizeof temp, "%d", i);
-		fldtab[i]->nval = xstrdup(temp);
+	c = xcalloc(n2 - n1 + 1, sizeof(Cell));
+	for (i = n1; i <= n2; i++, c++) {
+		*c = dollar1;
+		c->cnum = i;
+		fldtab[i] = c;
 	}
 }
 
@@ -334,21 +860,22 @@ record_build(void)
 
 	if (donerec == 1)
 		return;
+	stats.rebuilds++;
 	r = record;
 	for (i = 1; i <= *NF; i++) {
 		p = sval_get(fldtab[i]);
-		xadjbuf(&record, &recsize, 1+strlen(p)+r-record, recsize, &r,
+		xadjbuf(&record, &recsize, 1+strlen(p)+r-record, RECSIZE, &r,
 		    "record_build 1");
 		while ((*r = *p++) != 0)
 			r++;
 		if (i < *NF) {
 			xadjbuf(&record, &recsize, 2+strlen(" ")+r-record,
-			    recsize, &r, "record_build 2");
+			    RECSIZE, &r, "record_build 2");
 			for (p = " "; (*r = *p++) != 0; )
 				r++;
 		}
 	}
-	xadjbuf(&record, &recsize, 2+r-record, recsize, &r, "record_build 3");
+	xadjbuf(&record, &recsize, 2+r-record, RECSIZE, &r, "record_build 3");
 	*r = '\0';
 	   DPRINTF("in recbld fldtab[0]=%p\n", (void*)fldtab[0]);
 
@@ -366,17 +893,31 @@ record_build(void)
 /* wrong: violates 4.10.1.4 of ansi C standard */
 int
 is_number(const char *s)
+{
+	stats.isnum++;
+	return is_numval(s, NULL);
+}
+
+/*
+ * is_number(), also storing the value in *fp if it is one
+ *
+ * this one may be called from the threads of pipe.c
+ */
+int
+is_numval(const char *s, double *fp)
 {
 	double r;
 	char *ep;
+
 	errno = 0;
 	r = strtod(s, &ep);
 	if (ep == s || r == HUGE_VAL || errno == ERANGE)
 		return 0;
 	while (*ep == ' ' || *ep == '\t' || *ep == '\n')
 		ep++;
-	if (*ep == '\0')
-		return 1;
-	else
+	if (*ep != '\0')
 		return 0;
+	if (fp != NULL)
+		*fp = r;
+	return 1;
 }
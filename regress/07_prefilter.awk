@@ -0,0 +1,3 @@
+$2 == "Copyright" { print(NR, $0) }
+"*/" == $1 { print(NR, NF) }
+$3 == "with" { print(NR, $2) }
@@ -0,0 +1,2 @@
+NR % 5 == 0 { n++ }
+END { print(n, NR) }
@@ -0,0 +1,2 @@
+$4 >= 2000 { n++; s += $4 }
+END { print(n, s, NR) }
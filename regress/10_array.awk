@@ -0,0 +1,24 @@
+{ words[$1]++; n++ }
+END {
+	for (w in words) {
+		u++
+		if (words[w] > 1)
+			d++
+	}
+	print(n, u, d, words["*"])
+	delete words["*"]
+	if ("*" in words)
+		print("still there")
+	else
+		print("deleted")
+	delete words
+	for (w in words)
+		print("not empty")
+}
+END {
+	b[1] = "q"
+	a["zz", b[1]] = 5
+	for (k in a)
+		m++
+	print(m, a["zz", "q"])
+}
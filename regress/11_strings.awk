@@ -0,0 +1,13 @@
+{
+	a = $1; b = a; a = $2
+	if (b != $1)
+		print("bad copy", NR)
+	s = 123456789012340 + NR; l = 1234567890123400 + NR
+	if (s == "")
+		print("empty", NR)
+	if (l == "")
+		print("empty", NR)
+	t = s; u = l; s = NR; l = NR
+	w = $0; w = w
+}
+END { print(a, b, t, u, s, l, w) }
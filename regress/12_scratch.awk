@@ -0,0 +1,6 @@
+{
+	x = $0; $1 = x; y = $0
+	printf("%d %s|%10.3e\n", NR, $2, NR * 1e20)
+	big = NR * 1e20
+}
+END { print(x); print(y); print(big, big * 10) }
@@ -0,0 +1,17 @@
+{
+	n[NR] = NR * 0.1234567
+	v = n[NR]
+	if (v == "")
+		print("empty", NR)
+	s[NR] = $1
+	l[NR % 3] = $0
+}
+END {
+	for (k in n)
+		if (n[k] != k * 0.1234567)
+			print("bad number", k)
+	print(s[25], s[5], l[0], l[1], l[2], u["x"] + 1, u["y"])
+	k = 10
+	n[k] = n[k] + (n[k] = 5)
+	print(n[k], n[11])
+}
@@ -0,0 +1,3 @@
+BEGIN { print("begin") }
+NR > 3
+END { print("end", NR, $0) }
@@ -0,0 +1,2 @@
+NR > 5 { if (NR <= 8) print(NR, $0) }
+END { print(NR) }
@@ -0,0 +1 @@
+BEGIN { print("begin") }
@@ -0,0 +1,6 @@
+{
+	n += $1;
+	$2 = NR * 2;
+	x = $0
+}
+END { print(n, x) }
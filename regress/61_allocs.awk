@@ -0,0 +1,6 @@
+# a temporary, a variable and formatting for each record
+{
+	x = $0
+	printf("%s %d\n", $3, $4)
+	print($1 * 1e20)
+}
@@ -0,0 +1,7 @@
+{
+	n++;
+	if ($1 == "*")
+		c++;
+	$1 = "*"
+}
+END { print(n, c, NR) }
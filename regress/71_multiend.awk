@@ -0,0 +1,6 @@
+# changes the records, see 71_multiend.exit.awk
+{
+	$1 = "A";
+	s = $0
+}
+END { print("a", NR, $0) }
@@ -0,0 +1,6 @@
+# exits before the other program changed the records
+NR == 3 {
+	$1 = "B";
+	exit
+}
+END { print("b", NR, $0) }
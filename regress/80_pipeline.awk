@@ -0,0 +1,13 @@
+# NF is only set once the fields are split, as without -t
+{ m = m + NF }
+{
+	if ($1 > 0)
+		nums++
+	if (NF > 3)
+		$2 = NR
+	w[NR % 4] = $3
+	print(NF, $1, $0)
+}
+END {
+	print(NR, nums, w[0], w[1], w[2], w[3], $1, m)
+}
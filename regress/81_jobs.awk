@@ -0,0 +1,5 @@
+BEGIN { w = 2 }
+$w != "" {
+	$1 = NR
+	printf("%s|%d\n", $0, NF)
+}
@@ -0,0 +1,5 @@
+$1 != "" { n[$1] += 1; w[$1] = $2 }
+END {
+	for (k in n)
+		print(k, n[k], w[k])
+}
@@ -0,0 +1 @@
+{ x = $1; print(NR, NF, $0) }
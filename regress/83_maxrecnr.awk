@@ -0,0 +1,3 @@
+# the records before the range are skipped, in pieces
+NR > 20 { x = $1; print(NR, NF, $0) }
+END { print(NR) }
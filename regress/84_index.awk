@@ -0,0 +1 @@
+$1 != "" { $1 = NR; print($0) }
@@ -0,0 +1,3 @@
+# fails in more than one part, only the first failure is reported
+{ print($2) }
+$1 == "*" { print(1 / ($1 - $1)) }
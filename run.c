@@ -24,9 +24,12 @@ THIS SOFTWARE.
 ****************************************************************/
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <setjmp.h>
+#include <stddef.h>
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
@@ -39,23 +42,29 @@ THIS SOFTWARE.
 #define isexpr(n)	((n)->ntype == NEXPR)
 #define isnum(n)	((n)->tval & NUM)
 
-Cell		*tcell_get(void);
-void		 tcell_put(Cell *);
 int		 format(char **, int *, const char *, Node *);
 int		 pclose(FILE *);
 FILE		*popen(const char *, const char *);
 
 jmp_buf env;
 
-Cell	*tmps;		/* free temporary cells for execution */
+#define	TMPBLK		100	/* temporary cells allocated at once */
 
-static Cell	truecell	={ CTRUE, 0, 0, 1.0, NUM };
+Cell	**tmps;		/* free temporary cells for execution */
+int	 ntmps, tmpssize;
+Cell	**tmpblks;	/* all the temporary cells, by TMPBLK */
+int	 subused;	/* of the subscript buffer, see subscript() */
+char	**forinkeys;	/* of the for-in loops running, see f_forin() */
+int	 nforin, forinsize;
+
+static Cell	truecell	={ CTRUE, NUM, -1, 1.0, 0 };
 Cell	*True	= &truecell;
-static Cell	falsecell	={ CFALSE, 0, 0, 0.0, NUM };
+static Cell	falsecell	={ CFALSE, NUM, -1, 0.0, 0 };
 Cell	*False	= &falsecell;
-static Cell	tempcell	={ CTEMP, 0, "", 0.0, NUM|STR|DONTFREE };
+static Cell	tempcell	={ CTEMP, NUM|STR|DONTFREE, -1, 0.0, "" };
 
 Node	*curnode = NULL;	/* the node being executed, for debugging */
+FILE	*outfile;		/* where print and printf write */
 
 /* buffer memory management */
 /* pbuf:    address of pointer to buffer being managed
@@ -71,10 +80,14 @@ xadjbuf(char **pbuf, int *psiz, int minlen, int quantum, char **pbptr,
 {
 	if (minlen > *psiz) {
 		char *tbuf;
-		int rminlen = quantum ? minlen % quantum : 0;
+		int rminlen;
 		int boff = pbptr ? *pbptr - *pbuf : 0;
+		/* at least double, for a linear cost of growing in steps */
+		if (*psiz <= INT_MAX / 2 && minlen < *psiz * 2)
+			minlen = *psiz * 2;
+		rminlen = quantum ? minlen % quantum : 0;
 		/* round up to next multiple of quantum */
-		if (rminlen)
+		if (rminlen && minlen <= INT_MAX - quantum)
 			minlen += quantum - rminlen;
 		tbuf = xrealloc(*pbuf, minlen);
 		DPRINTF("adjbuf %s: %d %d (pbuf=%p, tbuf=%p)\n", whatrtn, *psiz, minlen, *pbuf, tbuf);
@@ -118,6 +131,7 @@ Cell *
 f_program(Node **a, int n)
 {
 	extern FILE *infile;
+	extern char *record;
 	Cell *x;
 
 	if (setjmp(env) != 0)
@@ -126,13 +140,37 @@ f_program(Node **a, int n)
 		x = execute(a[0]);
 		tcell_put(x);
 	}
-	if (a[1] || a[2]) {
-		while (record_get(infile) > 0) {
+	if (a[1] == NULL && a[2] == NULL)
+		goto ex;	/* the input is not read */
+	if (nrfirst > 1)
+		record_skipto(infile, nrfirst - 1);
+	if (profiling) {
+		prof_main(infile, a[1]);
+	} else if (nofields && a[1] == NULL) {
+		record_count(infile);
+	} else if (nofields) {
+		while ((nrlast == 0 || *NR < nrlast) &&
+		    record_skip(infile) > 0) {
+			x = execute(a[1]);
+			tcell_put(x);
+		}
+	} else if (kernel != NULL) {
+		kernel_run(infile, kernel);
+	} else if (passthrough) {
+		pass_run(infile, a[1]);
+	} else if (a[1] || a[2]) {
+		while ((nrlast == 0 || *NR < nrlast) &&
+		    record_get(infile) > 0) {
+			if (!prefilter_match(record, reclen))
+				continue;
 			x = execute(a[1]);
 			tcell_put(x);
 		}
 	}
+	if (nrcount)
+		record_count(infile);	/* for NR in END */
   ex:
+	pipe_stop();		/* no more input is read */
 	if (setjmp(env) != 0)	/* handles exit within END */
 		goto ex1;
 	if (a[2]) {		/* END */
@@ -204,13 +242,16 @@ f_relop(Node **a, int n)
 void
 tcell_put(Cell *a)
 {
-	if (!istemp(a))
+	if (!istemp(a)) {
+		if (iselem(a))
+			elem_put(a);
 		return;
+	}
 	cell_free(a);
-	if (a == tmps)
+	if (ntmps > 0 && a == tmps[ntmps-1])
 		FATAL("tempcell list is curdled");
-	a->cnext = tmps;
-	tmps = a;
+	a->ctype = CFREE;
+	tmps[ntmps++] = a;
 }
 
 /* get a tempcell */
@@ -219,25 +260,228 @@ tcell_get(void)
 {	int i;
 	Cell *x;
 
-	if (!tmps) {
-		tmps = xcalloc(100, sizeof(Cell));
-		for(i = 1; i < 100; i++)
-			tmps[i-1].cnext = &tmps[i];
-		tmps[i-1].cnext = 0;
+	if (ntmps == 0) {
+		x = xcalloc(TMPBLK, sizeof(Cell));
+		tmpblks = xreallocarray(tmpblks, tmpssize / TMPBLK + 1,
+		    sizeof(Cell *));
+		tmpblks[tmpssize / TMPBLK] = x;
+		tmpssize += TMPBLK;
+		tmps = xreallocarray(tmps, tmpssize, sizeof(Cell *));
+		for (i = 0; i < TMPBLK; i++)
+			tmps[ntmps++] = &x[i];
 	}
-	x = tmps;
-	tmps = x->cnext;
+	x = tmps[--ntmps];
 	*x = tempcell;
+	stats.temps++;
 	return x;
 }
 
+/*
+ * forget the evaluation left by a longjmp out of a run, before the next
+ * run: the temporary cells and Elems in use are freed, as are the keys
+ * of the for-in loops
+ */
+void
+run_reset(void)
+{
+	Cell *x;
+	int i;
+
+	ntmps = 0;
+	for (i = 0; i < tmpssize; i++) {
+		x = &tmpblks[i / TMPBLK][i % TMPBLK];
+		if (istemp(x))
+			cell_free(x);
+		x->ctype = CFREE;
+		tmps[ntmps++] = x;
+	}
+	elem_reset();
+	while (nforin > 0)
+		free(forinkeys[--nforin]);
+	subused = 0;
+}
+
 void
 cell_free(Cell *a)
 {
 	if ((a->tval & (STR|DONTFREE)) == STR) {
-		DPRINTF("freeing %s %s %o\n", NN(a->nval), NN(a->sval), a->tval);
-		xfree(a->sval);
+		DPRINTF("freeing %s %s %o\n", NN(cell_name(a)), NN(a->sval), a->tval);
+		rstr_put(a->sval);
+		a->sval = NULL;
+	}
+}
+
+/*
+ * Freeable string values are reference counted, so that assigning
+ * one from a Cell to another doesn't copy it.  Strings are never
+ * modified in place once created, so sharing them is safe.
+ *
+ * The initial values of the symbol table live in the arena and are
+ * never freed.
+ */
+struct rstr {
+	unsigned int	 refcnt;
+	unsigned int	 size;		/* of s */
+	char		 s[1];
+};
+
+#define	RSTR(p)		((struct rstr *)((p) - offsetof(struct rstr, s)))
+#define	RCONST		UINT_MAX	/* refcnt of a string in the arena */
+
+/*
+ * return a new reference counted copy of s
+ */
+char *
+rstr_new(const char *s)
+{
+	struct rstr *r;
+	size_t len = strlen(s), size;
+
+	/* malloc(3) rounds up anyway, leave room for rstr_reuse() */
+	size = (offsetof(struct rstr, s) + len + 1 + 15) & ~15;
+	r = xmalloc(size);
+	r->refcnt = 1;
+	r->size = size - offsetof(struct rstr, s);
+	memcpy(r->s, s, len + 1);
+	return r->s;
+}
+
+/*
+ * return s if it can be overwritten by a string of length len
+ */
+char *
+rstr_reuse(char *s, size_t len)
+{
+	struct rstr *r = RSTR(s);
+
+	if (r->refcnt != 1 || r->size <= len)
+		return NULL;
+	return s;
+}
+
+/*
+ * return a copy of s that lives as long as the program
+ */
+char *
+rstr_const(const char *s)
+{
+	struct rstr *r;
+	size_t len = strlen(s);
+
+	r = arena_alloc(sizeof(*r) + len);
+	r->refcnt = RCONST;
+	r->size = len + 1;
+	memcpy(r->s, s, len + 1);
+	return r->s;
+}
+
+/*
+ * take one more reference on s
+ */
+char *
+rstr_get(char *s)
+{
+	struct rstr *r = RSTR(s);
+
+	if (r->refcnt != RCONST)
+		r->refcnt++;
+	return s;
+}
+
+/*
+ * drop a reference on s
+ */
+void
+rstr_put(char *s)
+{
+	struct rstr *r;
+
+	if (s == NULL)
+		return;
+	r = RSTR(s);
+	if (r->refcnt != RCONST && --r->refcnt == 0)
+		free(r);
+}
+
+/*
+ * encode the value of a Cell
+ *
+ * A number and a string that don't agree can only be a number and its
+ * conversion, so only the number is kept.
+ */
+Value
+value_get(Cell *vp)
+{
+	union { double d; Value v; } u;
+	const char *s;
+	char *r;
+	size_t len;
+	Value v;
+	int num;
+
+	if ((vp->tval & (NUM|STR)) == NUM ||
+	    ((vp->tval & NUM) && atof(vp->sval) != vp->fval)) {
+		u.d = vp->fval;
+		if (isnan(u.d))
+			return 0x7ff8000000000000ULL;
+		return u.v;
 	}
+	num = (vp->tval & NUM) != 0;
+	s = vp->sval;
+	if ((len = strlen(s)) <= 6) {
+		for (v = 0; len > 0; len--)
+			v = (v << 8) | (unsigned char)s[len - 1];
+		return ((num ? VSHORTNUM : VSHORT) << 48) | v;
+	}
+	if ((vp->tval & (STR|DONTFREE)) == STR)
+		r = rstr_get(vp->sval);
+	else
+		r = rstr_new(s);
+	if ((uintptr_t)r >> 48)
+		FATAL("can't encode string at %p", (void *)r);
+	return ((num ? VSTRNUM : VSTR) << 48) | (uintptr_t)r;
+}
+
+/*
+ * set a Cell holding no string to the value v
+ */
+void
+value_load(Cell *vp, Value v)
+{
+	union { double d; Value v; } u;
+	uint64_t b;
+	int i;
+
+	if (visnum(v)) {
+		u.v = v;
+		vp->fval = u.d;
+		vp->tval = NUM;
+		return;
+	}
+	if (visshort(v)) {
+		for (i = 0, b = VBITS(v); b != 0; i++, b >>= 8)
+			vp->sbuf[i] = b & 0xff;
+		vp->sbuf[i] = '\0';
+		vp->sval = vp->sbuf;
+		vp->tval = STR|INLINE|DONTFREE;
+	} else {
+		vp->sval = rstr_get((char *)(uintptr_t)VBITS(v));
+		vp->tval = STR;
+	}
+	if (visstrnum(v)) {
+		vp->fval = atof(vp->sval);
+		vp->tval |= NUM;
+	}
+}
+
+/*
+ * drop the string referenced by v, if any
+ */
+void
+value_free(Value v)
+{
+	if (!visnum(v) && !visshort(v))
+		rstr_put((char *)(uintptr_t)VBITS(v));
 }
 
 /* $( a[0] ) */
@@ -252,11 +496,12 @@ f_indirect(Node **a, int n)
 	x = execute(a[0]);
 	val = fval_get(x);	/* freebsd: defend against super large field numbers */
 	if ((double)INT_MAX < val)
-		FATAL("trying to access out of range field %s", x->nval);
+		FATAL("trying to access out of range field %s",
+		    NN(cell_name(x)));
 	m = (int) val;
 	if (m == 0 && !is_number(s = sval_get(x)))	/* suspicion! */
-		FATAL("illegal field $(%s), name \"%s\"", s, x->nval);
-		/* BUG: can x->nval ever be null??? */
+		FATAL("illegal field $(%s), name \"%s\"", s,
+		    NN(cell_name(x)));
 	tcell_put(x);
 	x = field_get(m);
 	return x;
@@ -268,21 +513,25 @@ int
 format(char **pbuf, int *pbufsize, const char *s, Node *a)
 {
 #define	MAXNUMSIZE	50
-	char *fmt;
+	static char *fmt = NULL;
+	static int fmtsz = 0;
 	char *p, *t;
 	const char *os;
 	Cell *x;
 	int flag = 0, n;
 	int fmtwd; /* format width */
-	int fmtsz = recsize;
 	char *buf = *pbuf;
 	int bufsize = *pbufsize;
 
 	os = s;
 	p = buf;
-	fmt = xmalloc(fmtsz);
+	/* printf can't be nested in its arguments, so reuse the buffers */
+	if (fmt == NULL) {
+		fmtsz = RECSIZE;
+		fmt = xmalloc(fmtsz);
+	}
 	while (*s) {
-		xadjbuf(&buf, &bufsize, MAXNUMSIZE+1+p-buf, recsize, &p, "format1");
+		xadjbuf(&buf, &bufsize, MAXNUMSIZE+1+p-buf, RECSIZE, &p, "format1");
 		if (*s != '%') {
 			*p++ = *s++;
 			continue;
@@ -296,9 +545,9 @@ format(char **pbuf, int *pbufsize, const char *s, Node *a)
 		fmtwd = atoi(s+1);
 		if (fmtwd < 0)
 			fmtwd = -fmtwd;
-		xadjbuf(&buf, &bufsize, fmtwd+1+p-buf, recsize, &p, "format2");
+		xadjbuf(&buf, &bufsize, fmtwd+1+p-buf, RECSIZE, &p, "format2");
 		for (t = fmt; (*t++ = *s) != '\0'; s++) {
-			xadjbuf(&fmt, &fmtsz, MAXNUMSIZE+1+t-fmt, recsize, &t,
+			xadjbuf(&fmt, &fmtsz, MAXNUMSIZE+1+t-fmt, RECSIZE, &t,
 			    "format3");
 			if (isalpha((unsigned char)*s) && *s != 'l' && *s != 'h' && *s != 'L')
 				break;	/* the ansi panoply */
@@ -310,7 +559,7 @@ format(char **pbuf, int *pbufsize, const char *s, Node *a)
 				snprintf(t-1, fmt + fmtsz - (t-1), "%d", fmtwd=(int) fval_get(x));
 				if (fmtwd < 0)
 					fmtwd = -fmtwd;
-				xadjbuf(&buf, &bufsize, fmtwd+1+p-buf, recsize,
+				xadjbuf(&buf, &bufsize, fmtwd+1+p-buf, RECSIZE,
 				    &p, "format");
 				t = fmt + strlen(fmt);
 				tcell_put(x);
@@ -319,7 +568,7 @@ format(char **pbuf, int *pbufsize, const char *s, Node *a)
 		*t = '\0';
 		if (fmtwd < 0)
 			fmtwd = -fmtwd;
-		xadjbuf(&buf, &bufsize, fmtwd+1+p-buf, recsize, &p, "format4");
+		xadjbuf(&buf, &bufsize, fmtwd+1+p-buf, RECSIZE, &p, "format4");
 
 		switch (*s) {
 		case 'f': case 'e': case 'g': case 'E': case 'G':
@@ -352,7 +601,7 @@ format(char **pbuf, int *pbufsize, const char *s, Node *a)
 		n = MAXNUMSIZE;
 		if (fmtwd > n)
 			n = fmtwd;
-		xadjbuf(&buf, &bufsize, 1+n+p-buf, recsize, &p, "format5");
+		xadjbuf(&buf, &bufsize, 1+n+p-buf, RECSIZE, &p, "format5");
 		switch (flag) {
 		case '?':	/* unknown, so dump it too */
 			snprintf(p, buf + bufsize - p, "%s", fmt);
@@ -360,7 +609,7 @@ format(char **pbuf, int *pbufsize, const char *s, Node *a)
 			n = strlen(t);
 			if (fmtwd > n)
 				n = fmtwd;
-			xadjbuf(&buf, &bufsize, 1+strlen(p)+n+p-buf, recsize,
+			xadjbuf(&buf, &bufsize, 1+strlen(p)+n+p-buf, RECSIZE,
 			    &p, "format6");
 			p += strlen(p);
 			snprintf(p, buf + bufsize - p, "%s", t);
@@ -373,7 +622,7 @@ format(char **pbuf, int *pbufsize, const char *s, Node *a)
 			n = strlen(t);
 			if (fmtwd > n)
 				n = fmtwd;
-			xadjbuf(&buf, &bufsize, 1+n+p-buf, recsize, &p,
+			xadjbuf(&buf, &bufsize, 1+n+p-buf, RECSIZE, &p,
 			    "format7");
 			snprintf(p, buf + bufsize - p, fmt, t);
 			break;
@@ -396,9 +645,8 @@ format(char **pbuf, int *pbufsize, const char *s, Node *a)
 		s++;
 	}
 	*p = '\0';
-	free(fmt);
 	for ( ; a; a = a->nnext)		/* evaluate any remaining args */
-		execute(a);
+		tcell_put(execute(a));
 	*pbuf = buf;
 	*pbufsize = bufsize;
 	return p - buf;
@@ -409,14 +657,19 @@ format(char **pbuf, int *pbufsize, const char *s, Node *a)
 Cell *
 f_printf(Node **a, int n)
 {	/* a[0] is list of args, starting with format string */
-	FILE *fp = stdout;
+	FILE *fp = outfile;
 	Cell *x;
 	Node *y;
-	char *buf;
-	int len;
-	int bufsz=3*recsize;
+	static char *buf = NULL;
+	static int bufsz = 0;
+	int len, ph = PH_NONE;
 
-	buf = xmalloc(bufsz);
+	if (phasing)
+		ph = phase_enter(PH_OUTPUT);
+	if (buf == NULL) {
+		bufsz = 3*RECSIZE;
+		buf = xmalloc(bufsz);
+	}
 	y = a[0]->nnext;
 	x = execute(a[0]);
 	if ((len = format(&buf, &bufsz, sval_get(x), y)) == -1)
@@ -425,7 +678,8 @@ f_printf(Node **a, int n)
 	fwrite(buf, len, 1, fp);
 	if (ferror(fp))
 		FATAL("write error");
-	free(buf);
+	if (phasing)
+		phase_enter(ph);
 	return True;
 }
 
@@ -513,17 +767,17 @@ f_assign(Node **a, int n)
 		if (x == y && !(isfld(x) || isrec(x))) /* self-assignment: */
 			;		/* leave alone unless it's a field */
 		else if ((y->tval & (STR|NUM)) == (STR|NUM)) {
-			sval_set(x, sval_get(y));
+			sval_share(x, y);
 			x->fval = fval_get(y);
 			x->tval |= NUM;
 		}
 		else if (isstr(y))
-			sval_set(x, sval_get(y));
+			sval_share(x, y);
 		else if (isnum(y))
 			fval_set(x, fval_get(y));
 		else {
 			FATAL("incorrect assign %p: n=%s s=\"%s\" f=%g t=%o",
-			    y, y->nval, y->sval, y->fval, y->tval);
+			    y, NN(cell_name(y)), y->sval, y->fval, y->tval);
 		}
 		tcell_put(y);
 		return x;
@@ -616,10 +870,13 @@ f_if(Node **a, int n)
 Cell *
 f_print(Node **a, int n)
 {
-	FILE *fp = stdout;
+	FILE *fp = outfile;
 	Node *x;
 	Cell *y;
+	int ph = PH_NONE;
 
+	if (phasing)
+		ph = phase_enter(PH_OUTPUT);
 	for (x = a[0]; x != NULL; x = x->nnext) {
 		y = execute(x);
 		fputs(sval_get(y), fp);
@@ -631,6 +888,112 @@ f_print(Node **a, int n)
 	}
 	if (ferror(fp))
 		FATAL("write error");
+	if (phasing)
+		phase_enter(ph);
+	return True;
+}
+
+/*
+ * build the subscript a[0], a[0] SUBSEP a[1] ...
+ *
+ * the result is valid until the next call.  The parts may themselves
+ * use subscripts, which are built after the part of buf in use.
+ */
+char *
+subscript(Node *a)
+{
+	extern Cell *subseploc;
+	static char *buf;
+	static int bufsz;
+	char *s, *sep;
+	Cell *x;
+	int base = subused, off = subused, len;
+
+	for (; a != NULL; a = a->nnext) {
+		subused = off;
+		x = execute(a);
+		s = sval_get(x);
+		sep = a->nnext ? sval_get(subseploc) : "";
+		len = strlen(s) + strlen(sep);
+		xadjbuf(&buf, &bufsz, off+len+1, RECSIZE, NULL, "subscript");
+		off = stpcpy(stpcpy(buf + off, s), sep) - buf;
+		tcell_put(x);
+	}
+	subused = base;
+	return buf + base;
+}
+
+/* a[0][a[1]] */
+Cell *
+f_array(Node **a, int n)
+{
+	Cell *x;
+	char *k;
+
+	x = execute(a[0]);
+	if (!isarr(x))
+		FATAL("%s is not an array", NN(cell_name(x)));
+	k = subscript(a[1]);
+	return elem_get(amap_get((struct amap *)x->sval, k, 1));
+}
+
+/* a[0] in a[1] */
+Cell *
+f_intest(Node **a, int n)
+{
+	Cell *x;
+	char *k;
+
+	x = execute(a[1]);
+	if (!isarr(x))
+		FATAL("%s is not an array", NN(cell_name(x)));
+	k = subscript(a[0]);
+	if (amap_get((struct amap *)x->sval, k, 0) != NULL)
+		return True;
+	return False;
+}
+
+/* for (a[0] in a[1]) a[2] */
+Cell *
+f_forin(Node **a, int n)
+{
+	Cell *vp, *arrayp, *x;
+	char *buf, *k;
+	size_t i, nkeys;
+
+	vp = execute(a[0]);
+	arrayp = execute(a[1]);
+	if (!isarr(arrayp))
+		FATAL("%s is not an array", NN(cell_name(arrayp)));
+	/* iterate over a copy: the body may change the array */
+	nkeys = amap_keys((struct amap *)arrayp->sval, &buf);
+	if (nforin == forinsize) {
+		forinsize = forinsize * 2 + 8;
+		forinkeys = xreallocarray(forinkeys, forinsize, sizeof(char *));
+	}
+	forinkeys[nforin++] = buf;	/* for run_reset() */
+	for (i = 0, k = buf; i < nkeys; i++, k += strlen(k) + 1) {
+		sval_set(vp, k);
+		x = execute(a[2]);
+		tcell_put(x);
+	}
+	free(forinkeys[--nforin]);
+	return True;
+}
+
+/* delete a[0][a[1]], or all of a[0] */
+Cell *
+f_delete(Node **a, int n)
+{
+	Cell *x;
+
+	x = execute(a[0]);
+	if (!isarr(x))
+		FATAL("%s is not an array", NN(cell_name(x)));
+	if (a[1] == NULL)
+		amap_clear((struct amap *)x->sval);
+	else
+		amap_delete((struct amap *)x->sval, subscript(a[1]));
 	return True;
 }
 
@@ -648,16 +1011,19 @@ f_null(Node **a, int n)
 double
 fval_get(Cell *vp)
 {
+	if (isarr(vp))
+		FATAL("can't use array %s in scalar context", NN(cell_name(vp)));
 	assert(vp->tval & (NUM | STR));
 
 	record_cache(vp);
 	if (!isnum(vp)) {	/* not a number */
+		stats.atof++;
 		vp->fval = atof(vp->sval);	/* best guess */
 		if (is_number(vp->sval) && !(vp->tval&CON))
 			vp->tval |= NUM;	/* make NUM only sparingly */
 	}
 	   DPRINTF("getfval %p: %s = %g, t=%o\n",
-		(void*)vp, NN(vp->nval), vp->fval, vp->tval);
+		(void*)vp, NN(cell_name(vp)), vp->fval, vp->tval);
 	return(vp->fval);
 }
 
@@ -669,45 +1035,73 @@ fval_set(Cell *vp, double f)
 {
 	int fldno;
 
+	if (isarr(vp))
+		FATAL("can't assign to %s; it's an array name.", NN(cell_name(vp)));
 	assert(vp->tval & (NUM | STR));
 
 	if (isfld(vp)) {
-		fldno = atoi(vp->nval);
+		fldno = vp->cnum;
 		if (fldno > *NF)
 			field_add(fldno);
 		   DPRINTF("setting field %d to %g\n", fldno, f);
 	}
 	record_invalidate(vp);
+	if (iselem(vp))
+		((struct elem *)vp)->dirty = 1;
 	cell_free(vp);
 	vp->tval &= ~STR;	/* mark string invalid */
 	vp->tval |= NUM;	/* mark number ok */
-	   DPRINTF("setfval %p: %s = %g, t=%o\n", (void*)vp, NN(vp->nval), f, vp->tval);
+	   DPRINTF("setfval %p: %s = %g, t=%o\n", (void*)vp, NN(cell_name(vp)), f, vp->tval);
 	return vp->fval = f;
 }
 
+/*
+ * convert f to a string in s, returning its length
+ */
+int
+fmtnum(char *s, size_t size, double f)
+{
+	double dtemp;
+
+	if (modf(f, &dtemp) == 0)	/* it's integral */
+		return snprintf(s, size, "%.30g", f);
+	return snprintf(s, size, "%.6g", f);
+}
+
 /*
  * get string val of a Cell
  */
 char *
 sval_get(Cell *vp)
 {
+	char s[100];
 	int n;
-	double dtemp;
 
+	if (isarr(vp))
+		FATAL("can't use array %s in scalar context", NN(cell_name(vp)));
 	assert(vp->tval & (NUM | STR));
 
 	record_cache(vp);
 	if (isstr(vp) == 0) {
+		stats.fmtnum++;
 		cell_free(vp);
-		if (modf(vp->fval, &dtemp) == 0)	/* it's integral */
-			n = xasprintf(&vp->sval, "%.30g", vp->fval);
-		else
-			n = xasprintf(&vp->sval, "%.6g", vp->fval);
-		vp->tval &= ~DONTFREE;
+		n = fmtnum(s, sizeof(s), vp->fval);
+		if (n < CELLSTR) {
+			memcpy(vp->sbuf, s, n + 1);
+			vp->sval = vp->sbuf;
+			vp->tval |= INLINE|DONTFREE;
+		} else if (istemp(vp)) {
+			vp->sval = memcpy(tmp_alloc(n + 1), s, n + 1);
+			vp->tval &= ~INLINE;
+			vp->tval |= DONTFREE;
+		} else {
+			vp->sval = rstr_new(s);
+			vp->tval &= ~(INLINE|DONTFREE);
+		}
 		vp->tval |= STR;
 	}
 	   DPRINTF("getsval %p: %s = \"%s (%p)\", t=%o\n",
-		(void*)vp, NN(vp->nval), vp->sval, vp->sval, vp->tval);
+		(void*)vp, NN(cell_name(vp)), vp->sval, vp->sval, vp->tval);
 	return(vp->sval);
 }
 
@@ -717,26 +1111,80 @@ sval_get(Cell *vp)
 char *
 sval_set(Cell *vp, const char *s)
 {
-	char *t;
+	char t[CELLSTR], *p;
+	size_t len;
+
+	len = strlen(s);
+	/* overwrite our own copy if it is large enough, even if s is short */
+	if ((vp->tval & (STR|DONTFREE)) == STR &&
+	    (p = rstr_reuse(vp->sval, len)) != NULL) {
+		memmove(p, s, len + 1);
+		return sval_assign(vp, rstr_get(p));
+	}
+	if (len >= CELLSTR) {
+		if (istemp(vp)) {
+			p = memcpy(tmp_alloc(len + 1), s, len + 1);
+			sval_assign(vp, p);
+			vp->tval |= DONTFREE;
+			return p;
+		}
+		return sval_assign(vp, rstr_new(s));	/* in case it's self-assign */
+	}
+	/* short enough to live in the Cell */
+	memcpy(t, s, len + 1);
+	sval_assign(vp, NULL);
+	memcpy(vp->sbuf, t, len + 1);
+	return vp->sval;
+}
+
+/*
+ * set string val of a Cell to the one of another, sharing it if possible
+ */
+char *
+sval_share(Cell *vp, Cell *from)
+{
+	char *s;
+
+	s = sval_get(from);
+	if ((from->tval & (STR|DONTFREE)) != STR)
+		return sval_set(vp, s);		/* borrowed or inline */
+	return sval_assign(vp, rstr_get(s));
+}
+
+/*
+ * set string val of a Cell to t, a reference counted string whose
+ * reference is handed over, or to its sbuf if t is NULL
+ */
+char *
+sval_assign(Cell *vp, char *t)
+{
 	int fldno;
 
 	   DPRINTF("starting sval_set %p: %s = \"%s\", t=%o\n",
-		(void*)vp, NN(vp->nval), s, vp->tval);
+		(void*)vp, NN(cell_name(vp)), t, vp->tval);
+	if (isarr(vp))
+		FATAL("can't assign to %s; it's an array name.", NN(cell_name(vp)));
 	assert(vp->tval & (NUM | STR));
 
 	if (isfld(vp)) {
-		fldno = atoi(vp->nval);
+		fldno = vp->cnum;
 		if (fldno > *NF)
 			field_add(fldno);
-		   DPRINTF("setting field %d to %s (%p)\n", fldno, s, s);
+		   DPRINTF("setting field %d to %s (%p)\n", fldno, t, t);
 	}
 	record_invalidate(vp);
-	t = xstrdup(s);	/* in case it's self-assign */
+	if (iselem(vp))
+		((struct elem *)vp)->dirty = 1;
 	cell_free(vp);
 	vp->tval &= ~NUM;
 	vp->tval |= STR;
-	vp->tval &= ~DONTFREE;
+	if (t == NULL) {
+		vp->sbuf[0] = '\0';
+		t = vp->sbuf;
+		vp->tval |= INLINE|DONTFREE;
+	} else
+		vp->tval &= ~(INLINE|DONTFREE);
 	   DPRINTF("setsval %p: %s = \"%s (%p) \", t=%o\n",
-		(void*)vp, NN(vp->nval), t,t, vp->tval);
+		(void*)vp, NN(cell_name(vp)), t,t, vp->tval);
 	return(vp->sval = t);
 }
@@ -0,0 +1,234 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Server mode, enabled by -S socket.
+ *
+ * The program is parsed once, then run for every job sent on a Unix
+ * socket.  A job is a struct sjob passed with two or three descriptors
+ * as SCM_RIGHTS: the input, the output and optionally the standard
+ * error.  The reply is the exit status of the run, as an int.  A client
+ * can send any number of jobs on a connection, and connections are
+ * served in turn, one job at a time.
+ *
+ * Between jobs the variables get back their values from before BEGIN,
+ * arrays are emptied and the input state is reset; nothing else is
+ * kept from a run to the next.  A fatal error ends the job, not the
+ * server.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "awk.h"
+
+#define	SJOBMAGIC	0x75617731	/* "uaw1" */
+#define	MAXCLIENTS	64
+
+struct sjob {
+	uint32_t	 magic;
+};
+
+int		 serving = 0;
+jmp_buf		 servejmp;	/* back to the server on FATAL */
+
+int		 serve_listen(const char *);
+int		 serve_recv(int, int *);
+int		 serve_job(int *, int);
+
+/*
+ * end the current job, for FATAL
+ */
+__dead void
+serve_abort(void)
+{
+	longjmp(servejmp, 1);
+}
+
+int
+serve_listen(const char *path)
+{
+	struct sockaddr_un sun;
+	struct stat st;
+	int s;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlcpy(sun.sun_path, path, sizeof(sun.sun_path)) >=
+	    sizeof(sun.sun_path))
+		errx(1, "socket path too long: %s", path);
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	/* the socket of a previous server, nothing else */
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+	if (bind(s, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+		err(1, "bind %s", path);
+	if (listen(s, 16) == -1)
+		err(1, "listen");
+	return s;
+}
+
+/*
+ * read a job from the client `c', returns the number of descriptors
+ * passed, 0 at the end of the connection and -1 on error
+ */
+int
+serve_recv(int c, int *fds)
+{
+	union {
+		struct cmsghdr	 hdr;
+		char		 buf[CMSG_SPACE(3 * sizeof(int))];
+	} cmsgbuf;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	struct sjob job;
+	ssize_t n;
+	int i, nfds = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &job;
+	iov.iov_len = sizeof(job);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = &cmsgbuf.buf;
+	msg.msg_controllen = sizeof(cmsgbuf.buf);
+	while ((n = recvmsg(c, &msg, 0)) == -1 && errno == EINTR)
+		;
+	if (n <= 0)
+		return n;
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+	    cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+	}
+	if (n != sizeof(job) || job.magic != SJOBMAGIC || nfds < 2 ||
+	    nfds > 3 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+		return -1;
+	}
+	return nfds;
+}
+
+/*
+ * run the program with the descriptors of a job, returns its status
+ */
+int
+serve_job(int *fds, int nfds)
+{
+	extern FILE *infile;
+	static int out = -1, errfd = -1;
+	volatile int status;
+
+	if (out == -1 && ((out = dup(STDOUT_FILENO)) == -1 ||
+	    (errfd = dup(STDERR_FILENO)) == -1))
+		err(1, "dup");
+
+	run_reset();
+	symtab_restore();
+	record_reset();
+	errorflag = 0;
+	if ((infile = fdopen(fds[0], "r")) == NULL)
+		err(1, "fdopen");
+	dup2(fds[1], STDOUT_FILENO);
+	close(fds[1]);
+	if (nfds == 3) {
+		dup2(fds[2], STDERR_FILENO);
+		close(fds[2]);
+	}
+
+	if (setjmp(servejmp) == 0) {
+		execute(rootnode);
+		status = errorflag;
+	} else
+		status = 2;
+	if (fflush(stdout) == EOF && status == 0)
+		status = 2;
+	clearerr(stdout);
+	fflush(stderr);
+
+	fclose(infile);
+	infile = NULL;
+	dup2(out, STDOUT_FILENO);
+	dup2(errfd, STDERR_FILENO);
+	return status;
+}
+
+/*
+ * serve jobs on the socket `path', forever
+ */
+__dead void
+serve(const char *path)
+{
+	struct pollfd pfd[1 + MAXCLIENTS];
+	int fds[3], i, n, nfds, npfd = 1, status;
+
+	signal(SIGPIPE, SIG_IGN);
+	pfd[0].fd = serve_listen(path);
+	pfd[0].events = POLLIN;
+	symtab_save();
+	serving = 1;
+
+	for (;;) {
+		pfd[0].events = npfd < nitems(pfd) ? POLLIN : 0;
+		if (poll(pfd, npfd, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "poll");
+		}
+		for (i = npfd - 1; i > 0; i--) {
+			if (pfd[i].revents == 0)
+				continue;
+			if ((nfds = serve_recv(pfd[i].fd, fds)) > 0) {
+				status = serve_job(fds, nfds);
+				if (write(pfd[i].fd, &status, sizeof(status)) ==
+				    sizeof(status))
+					continue;
+			}
+			close(pfd[i].fd);
+			pfd[i] = pfd[--npfd];
+		}
+		if (pfd[0].revents & POLLIN) {
+			if ((n = accept(pfd[0].fd, NULL, NULL)) == -1) {
+				if (errno != EINTR && errno != ECONNABORTED)
+					warn("accept");
+				continue;
+			}
+			pfd[npfd].fd = n;
+			pfd[npfd].events = POLLIN;
+			npfd++;
+		}
+	}
+}
@@ -24,31 +24,55 @@ THIS SOFTWARE.
 ****************************************************************/
 
 #include <errno.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include "awk.h"
 
-#define	FULLTAB	2		/* rehash when table gets this x full */
-#define	GROWTAB 4		/* grow table by this factor */
+#define	FULLTAB	2		/* grow table when it gets 1/FULLTAB full */
+#define	SYMBLK	64		/* Cells allocated at once, contiguously */
 
-struct array {			/* symbol table array */
-	int	nelem;		/* elements in table right now */
-	int	size;		/* size of tab */
-	Cell	**tab;		/* hash table pointers */
+/*
+ * Symbol table: open addressing with linear probing over a power of
+ * two table.  Each entry keeps the hash of the name, so growing the
+ * table and most failed comparisons don't touch the names.
+ *
+ * Every symbol gets a dense slot number in order of creation.  Cells
+ * are allocated by blocks of SYMBLK, so the variables of a program are
+ * laid out contiguously and symtab_slot() is a flat array access.
+ * Names are kept apart, by slot, as they are only needed by lookups
+ * and messages.
+ */
+struct symslot {
+	uint32_t	 hash;
+	int		 slot;		/* -1 if empty */
+};
+
+struct symtab {
+	int		 nelem;		/* elements in table right now */
+	int		 size;		/* size of tab, a power of 2 */
+	struct symslot	*tab;
+	Cell		**blk;		/* blocks of SYMBLK Cells */
+	char		**names;	/* name of each slot */
+	int		 nblk;
 };
 
-#define	NSYMTAB	50		/* initial size of a symbol table */
-struct array	*symtab;	/* main symbol table */
+#define	NSYMTAB	64		/* initial size of a symbol table */
+struct symtab	*symtab;	/* main symbol table */
 
 Cell		*nullloc;	/* empty cell, used for if(x)... tests */
 Cell		*literal0;
+Cell		*subseploc;	/* SUBSEP */
 
-int		 hash(const char *, int);
-Cell		*lookup(const char *, struct array *);
-void		 rehash(struct array *);
-struct array	*symtab_alloc(int);
+/* initial values of the variables, see symtab_save() */
+Cell		*symsaved;
+int		 nsymsaved;
+
+Cell		*lookup(const char *, uint32_t, struct symtab *);
+void		 rehash(struct symtab *);
+struct symtab	*symtab_alloc(int);
 
 void
 symtab_init(void)
@@ -58,100 +82,217 @@ symtab_init(void)
 	literal0 = symtab_set("0", "0", 0.0, NUM|STR|CON|DONTFREE);
 	nullloc = symtab_set("$zero&null", "", 0.0, NUM|STR|CON|DONTFREE);
 	nullnode = cell2node(nullloc, CCON);
+	subseploc = symtab_set("SUBSEP", "\034", 0.0, STR|DONTFREE);
 }
 
-struct array *
+struct symtab *
 symtab_alloc(int n)
 {
-	struct array *ap;
-	Cell **tp;
-
-	ap = xmalloc(sizeof(*ap));
-	tp = xcalloc(n, sizeof(Cell *));
-	ap->nelem = 0;
-	ap->size = n;
-	ap->tab = tp;
-	return ap;
+	struct symtab *tp;
+	int i;
+
+	tp = xmalloc(sizeof(*tp));
+	tp->tab = xcalloc(n, sizeof(struct symslot));
+	for (i = 0; i < n; i++)
+		tp->tab[i].slot = -1;
+	tp->nelem = 0;
+	tp->size = n;
+	tp->blk = NULL;
+	tp->names = NULL;
+	tp->nblk = 0;
+	return tp;
 }
 
 Cell *
 symtab_set(const char *n, const char *s, double f, unsigned t)
 {
-	struct array *tp = symtab;
-	int h;
+	struct symtab *tp = symtab;
+	uint32_t h;
+	int i, slot;
 	Cell *p;
 
-	if (n != NULL && (p = lookup(n, tp)) != NULL) {
+	h = hash(n, strlen(n));
+	if ((p = lookup(n, h, tp)) != NULL) {
 		   DPRINTF("setsymtab found %p: n=%s s=\"%s\" f=%g t=%o\n",
-			(void*)p, NN(p->nval), NN(p->sval), p->fval, p->tval);
+			(void*)p, n, NN(p->sval), p->fval, p->tval);
 		return p;
 	}
-	p = xmalloc(sizeof(Cell));
-	p->nval = xstrdup(n);
-	p->sval = s ? xstrdup(s) : xstrdup("");
+	slot = tp->nelem;
+	if (slot == tp->nblk * SYMBLK) {
+		tp->blk = xreallocarray(tp->blk, tp->nblk + 1, sizeof(Cell *));
+		tp->blk[tp->nblk++] = arena_alloc(SYMBLK * sizeof(Cell));
+		tp->names = xreallocarray(tp->names, tp->nblk * SYMBLK,
+		    sizeof(char *));
+	}
+	p = &tp->blk[slot / SYMBLK][slot % SYMBLK];
+	tp->names[slot] = arena_strdup(n);
+	p->sval = rstr_const(s ? s : "");
 	p->fval = f;
 	p->tval = t;
 	p->ctype = CUNK;
+	p->cnum = slot;
 	tp->nelem++;
-	if (tp->nelem > FULLTAB * tp->size)
+	if (tp->nelem * FULLTAB > tp->size)
 		rehash(tp);
-	h = hash(n, tp->size);
-	p->cnext = tp->tab[h];
-	tp->tab[h] = p;
+	for (i = h & (tp->size - 1); tp->tab[i].slot != -1;
+	    i = (i + 1) & (tp->size - 1))
+		;
+	tp->tab[i].hash = h;
+	tp->tab[i].slot = slot;
 	   DPRINTF("setsymtab set %p: n=%s s=\"%s\" f=%g t=%o\n",
-		(void*)p, p->nval, p->sval, p->fval, p->tval);
+		(void*)p, n, p->sval, p->fval, p->tval);
 	return p;
 }
 
 /*
- * form hash value for string s
+ * return the Cell of a name, or NULL
+ */
+Cell *
+symtab_lookup(const char *n)
+{
+	return lookup(n, hash(n, strlen(n)), symtab);
+}
+
+/*
+ * return the Cell in a given slot, or NULL
+ */
+Cell *
+symtab_slot(int slot)
+{
+	if (slot < 0 || slot >= symtab->nelem)
+		return NULL;
+	return &symtab->blk[slot / SYMBLK][slot % SYMBLK];
+}
+
+/*
+ * number of slots in use
  */
 int
-hash(const char *s, int n)
+symtab_nslots(void)
+{
+	return symtab->nelem;
+}
+
+/*
+ * name of a Cell for messages: a variable, a field number or NULL
+ */
+const char *
+cell_name(Cell *p)
+{
+	static char buf[16];
+
+	if (isfld(p) || isrec(p)) {
+		snprintf(buf, sizeof(buf), "%d", p->cnum);
+		return buf;
+	}
+	if (p->cnum < 0 || p->cnum >= symtab->nelem)
+		return NULL;
+	return symtab->names[p->cnum];
+}
+
+/*
+ * form hash value for the len bytes at s
+ *
+ * FNV-1a followed by the MurmurHash3 finalizer, so that all the
+ * bits of the result depend on all the bytes of the key.
+ */
+uint64_t
+hash(const void *s, size_t len)
 {
-	unsigned hashval;
+	const unsigned char *p = s;
+	uint64_t h = 0xcbf29ce484222325ULL;
 
-	for (hashval = 0; *s != '\0'; s++)
-		hashval = (*s + 31 * hashval);
-	return hashval % n;
+	while (len-- > 0) {
+		h ^= *p++;
+		h *= 0x100000001b3ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
 }
 
 /*
- * rehash items in small table into big one
+ * double the size of the table
  */
 void
-rehash(struct array *tp)
+rehash(struct symtab *tp)
 {
-	int i, nh, nsz;
-	Cell *cp, *op, **np;
+	struct symslot *ntab;
+	int i, j, nsz;
 
-	nsz = GROWTAB * tp->size;
-	np = xcalloc(nsz, sizeof(Cell *));
+	nsz = 2 * tp->size;
+	ntab = xcalloc(nsz, sizeof(struct symslot));
+	for (i = 0; i < nsz; i++)
+		ntab[i].slot = -1;
 	for (i = 0; i < tp->size; i++) {
-		for (cp = tp->tab[i]; cp; cp = op) {
-			op = cp->cnext;
-			nh = hash(cp->nval, nsz);
-			cp->cnext = np[nh];
-			np[nh] = cp;
-		}
+		if (tp->tab[i].slot == -1)
+			continue;
+		for (j = tp->tab[i].hash & (nsz - 1); ntab[j].slot != -1;
+		    j = (j + 1) & (nsz - 1))
+			;
+		ntab[j] = tp->tab[i];
 	}
 	free(tp->tab);
-	tp->tab = np;
+	tp->tab = ntab;
 	tp->size = nsz;
 }
 
 /*
- * look for s in tp
+ * look for s, of hash h, in tp
  */
 Cell *
-lookup(const char *s, struct array *tp)
+lookup(const char *s, uint32_t h, struct symtab *tp)
 {
-	Cell *p;
-	int h;
+	int i, slot;
 
-	h = hash(s, tp->size);
-	for (p = tp->tab[h]; p != NULL; p = p->cnext)
-		if (strcmp(s, p->nval) == 0)
-			return p;	/* found it */
+	for (i = h & (tp->size - 1); tp->tab[i].slot != -1;
+	    i = (i + 1) & (tp->size - 1)) {
+		if (tp->tab[i].hash != h)
+			continue;
+		slot = tp->tab[i].slot;
+		if (strcmp(s, tp->names[slot]) == 0)	/* found it */
+			return &tp->blk[slot / SYMBLK][slot % SYMBLK];
+	}
 	return NULL;			/* not found */
 }
+
+/*
+ * remember the values of all the symbols, to get them back with
+ * symtab_restore() before running the program again
+ */
+void
+symtab_save(void)
+{
+	int i;
+
+	nsymsaved = symtab->nelem;
+	symsaved = xreallocarray(symsaved, nsymsaved, sizeof(Cell));
+	for (i = 0; i < nsymsaved; i++)
+		symsaved[i] = *symtab_slot(i);
+}
+
+/*
+ * give the symbols their saved values, and empty the arrays
+ */
+void
+symtab_restore(void)
+{
+	Cell *p;
+	int i;
+
+	for (i = 0; i < nsymsaved; i++) {
+		p = symtab_slot(i);
+		if (isarr(p)) {
+			amap_clear((struct amap *)p->sval);
+			continue;
+		}
+		cell_free(p);
+		/* saved strings are constant, never inline */
+		p->tval = symsaved[i].tval;
+		p->fval = symsaved[i].fval;
+		p->sval = symsaved[i].sval;
+	}
+}
@@ -0,0 +1,328 @@
+/*	$OpenBSD$	*/
+
+/*
+ * Copyright (c) 2026 The uawk contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Input read ahead with io_uring(7), enabled by -u.
+ *
+ * NSLOT reads of SLOTSIZE bytes at consecutive offsets of the input
+ * are kept in flight.  uring_read() is called by input_fill() in place
+ * of read(2): it copies from the oldest slot, waiting for it if needed,
+ * and queues the next read in a slot once it has been emptied.  A
+ * short read marks the end of the file.
+ *
+ * The slots are registered with the kernel when it allows it.  With
+ * -uu the input is read with O_DIRECT, bypassing the buffer cache, if
+ * the file system supports it.
+ *
+ * Anything but a regular file, or a kernel without io_uring, is read
+ * with read(2), as is everything on other systems.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "awk.h"
+
+int		 uringing = 0;		/* -u, 2 for O_DIRECT */
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+
+#define	NSLOT		8
+#define	SLOTSIZE	(1024 * 1024)
+
+#define	US_IDLE		0
+#define	US_BUSY		1		/* read in flight */
+#define	US_DONE		2
+
+struct uslot {
+	char		*buf;
+	off_t		 off;		/* of the read in the file */
+	int		 state;
+	int		 res;		/* bytes read or -errno */
+	int		 pos;		/* bytes already copied out */
+};
+
+struct uring {
+	int		 fd;		/* the ring */
+	int		 infd;		/* -1 if not set up, -2 to use read */
+	int		 fixed;		/* slots are registered */
+	int		 direct;	/* input opened with O_DIRECT */
+	int		 eof;		/* a short read was seen */
+	int		 busy;		/* reads in flight */
+	off_t		 next;		/* offset of the next read */
+	int		 cur;		/* oldest slot */
+	unsigned	*sqtail, *sqmask, *sqarray;
+	struct io_uring_sqe *sqes;
+	unsigned	*cqhead, *cqtail, *cqmask;
+	struct io_uring_cqe *cqes;
+	struct uslot	 slot[NSLOT];
+} ur = { -1, -1 };
+
+int		 uring_setup(int);
+void		 uring_queue(struct uslot *);
+int		 uring_wait(void);
+
+/*
+ * read(2) from the input fd, through the ring if possible
+ */
+ssize_t
+uring_read(int fd, void *dst, size_t n)
+{
+	struct uslot *s;
+	size_t k;
+
+	if (fd != ur.infd && ur.infd != -2) {
+		uring_reset();
+		if (uring_setup(fd) == -1)
+			ur.infd = -2;
+	}
+	if (ur.infd == -2)
+		return read(fd, dst, n);
+	for (;;) {
+		s = &ur.slot[ur.cur];
+		if (s->state == US_IDLE)
+			return 0;	/* after the end of file */
+		if (s->state == US_BUSY) {
+			if (uring_wait() == -1)
+				return -1;
+			continue;
+		}
+		if (s->res == -EINVAL && ur.direct) {
+			/* O_DIRECT is not supported by the file system */
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+			ur.direct = 0;
+			uring_queue(s);
+			continue;
+		}
+		if (s->res == -EINTR || s->res == -EAGAIN) {
+			uring_queue(s);
+			continue;
+		}
+		if (s->res < 0) {
+			errno = -s->res;
+			return -1;
+		}
+		if (s->pos < s->res)
+			break;
+		/* empty, reuse it for the read after the last one */
+		s->state = US_IDLE;
+		if (s->res < SLOTSIZE)
+			ur.eof = 1;
+		if (!ur.eof) {
+			s->off = ur.next;
+			ur.next += SLOTSIZE;
+			uring_queue(s);
+		}
+		ur.cur = (ur.cur + 1) % NSLOT;
+	}
+	k = s->res - s->pos;
+	if (k > n)
+		k = n;
+	memcpy(dst, s->buf + s->pos, k);
+	s->pos += k;
+	return k;
+}
+
+int
+uring_setup(int fd)
+{
+	struct io_uring_params p;
+	struct iovec iov[NSLOT];
+	struct stat st;
+	size_t sqsize, cqsize;
+	char *sq, *cq, *bufs;
+	off_t off;
+	int i;
+
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+		return -1;
+	if ((off = lseek(fd, 0, SEEK_CUR)) == -1)
+		return -1;
+	if (ur.fd == -1) {
+		memset(&p, 0, sizeof(p));
+		if ((ur.fd = syscall(SYS_io_uring_setup, NSLOT, &p)) == -1)
+			return -1;
+		sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cqsize = p.cq_off.cqes +
+		    p.cq_entries * sizeof(struct io_uring_cqe);
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			if (cqsize > sqsize)
+				sqsize = cqsize;
+		}
+		sq = mmap(NULL, sqsize, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_SQ_RING);
+		if (sq == MAP_FAILED)
+			goto fail;
+		cq = sq;
+		if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+			cq = mmap(NULL, cqsize, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, ur.fd,
+			    IORING_OFF_CQ_RING);
+			if (cq == MAP_FAILED)
+				goto fail;
+		}
+		ur.sqes = mmap(NULL, p.sq_entries * sizeof(*ur.sqes),
+		    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur.fd,
+		    IORING_OFF_SQES);
+		if (ur.sqes == MAP_FAILED)
+			goto fail;
+		ur.sqtail = (unsigned *)(sq + p.sq_off.tail);
+		ur.sqmask = (unsigned *)(sq + p.sq_off.ring_mask);
+		ur.sqarray = (unsigned *)(sq + p.sq_off.array);
+		ur.cqhead = (unsigned *)(cq + p.cq_off.head);
+		ur.cqtail = (unsigned *)(cq + p.cq_off.tail);
+		ur.cqmask = (unsigned *)(cq + p.cq_off.ring_mask);
+		ur.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+		/* page aligned, as O_DIRECT wants */
+		bufs = mmap(NULL, NSLOT * SLOTSIZE, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (bufs == MAP_FAILED)
+			goto fail;
+		for (i = 0; i < NSLOT; i++) {
+			ur.slot[i].buf = bufs + i * SLOTSIZE;
+			iov[i].iov_base = ur.slot[i].buf;
+			iov[i].iov_len = SLOTSIZE;
+		}
+		/* may fail with a low RLIMIT_MEMLOCK */
+		ur.fixed = syscall(SYS_io_uring_register, ur.fd,
+		    IORING_REGISTER_BUFFERS, iov, NSLOT) == 0;
+	}
+	ur.direct = 0;
+	if (uringing > 1 && off % getpagesize() == 0 &&
+	    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) != -1)
+		ur.direct = 1;
+	   DPRINTF("io_uring: fixed %d, direct %d\n", ur.fixed, ur.direct);
+	ur.infd = fd;
+	ur.eof = 0;
+	ur.cur = 0;
+	ur.next = off;
+	for (i = 0; i < NSLOT; i++) {
+		ur.slot[i].off = ur.next;
+		ur.next += SLOTSIZE;
+		uring_queue(&ur.slot[i]);
+	}
+	return 0;
+  fail:
+	close(ur.fd);
+	ur.fd = -1;
+	return -1;
+}
+
+/*
+ * start reading slot s
+ */
+void
+uring_queue(struct uslot *s)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail, i;
+
+	tail = *ur.sqtail;
+	i = tail & *ur.sqmask;
+	sqe = &ur.sqes[i];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = ur.fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd = ur.infd;
+	sqe->addr = (uintptr_t)s->buf;
+	sqe->len = SLOTSIZE;
+	sqe->off = s->off;
+	sqe->buf_index = s - ur.slot;
+	sqe->user_data = s - ur.slot;
+	ur.sqarray[i] = i;
+	__atomic_store_n(ur.sqtail, tail + 1, __ATOMIC_RELEASE);
+	s->state = US_BUSY;
+	s->pos = 0;
+	ur.busy++;
+	while (syscall(SYS_io_uring_enter, ur.fd, 1, 0, 0, NULL, 0) == -1) {
+		if (errno != EINTR && errno != EAGAIN)
+			FATAL("io_uring_enter: %s", strerror(errno));
+	}
+}
+
+/*
+ * wait for at least one read to complete
+ */
+int
+uring_wait(void)
+{
+	struct io_uring_cqe *cqe;
+	struct uslot *s;
+	unsigned head;
+
+	while (syscall(SYS_io_uring_enter, ur.fd, 0, 1,
+	    IORING_ENTER_GETEVENTS, NULL, 0) == -1) {
+		if (errno != EINTR)
+			return -1;
+	}
+	head = *ur.cqhead;
+	while (head != __atomic_load_n(ur.cqtail, __ATOMIC_ACQUIRE)) {
+		cqe = &ur.cqes[head & *ur.cqmask];
+		s = &ur.slot[cqe->user_data];
+		s->res = cqe->res;
+		s->state = US_DONE;
+		ur.busy--;
+		head++;
+	}
+	__atomic_store_n(ur.cqhead, head, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*
+ * forget the current input, the slots are reused for the next one
+ */
+void
+uring_reset(void)
+{
+	int i;
+
+	while (ur.busy > 0 && uring_wait() == 0)
+		;
+	if (ur.direct)
+		fcntl(ur.infd, F_SETFL, fcntl(ur.infd, F_GETFL) & ~O_DIRECT);
+	ur.direct = 0;
+	for (i = 0; i < NSLOT; i++)
+		ur.slot[i].state = US_IDLE;
+	ur.infd = -1;
+}
+
+#else
+
+ssize_t
+uring_read(int fd, void *dst, size_t n)
+{
+	return read(fd, dst, n);
+}
+
+void
+uring_reset(void)
+{
+}
+
+#endif
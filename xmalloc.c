@@ -24,11 +24,27 @@
 
 #include "awk.h"
 
+struct asite	*asites;	/* call sites seen so far */
+
+/*
+ * count an allocation made at call site `as'
+ */
+static inline void
+asite_add(struct asite *as, size_t size)
+{
+	if (as->count++ == 0) {
+		as->next = asites;
+		asites = as;
+	}
+	as->bytes += size;
+}
+
 void *
-xmalloc(size_t size)
+xmalloc_at(struct asite *as, size_t size)
 {
 	void *ptr;
 
+	asite_add(as, size);
 	if (size == 0)
 		errx(1, "xmalloc: zero size");
 	ptr = malloc(size);
@@ -38,10 +54,11 @@ xmalloc(size_t size)
 }
 
 void *
-xcalloc(size_t nmemb, size_t size)
+xcalloc_at(struct asite *as, size_t nmemb, size_t size)
 {
 	void *ptr;
 
+	asite_add(as, nmemb * size);
 	if (size == 0 || nmemb == 0)
 		errx(1, "xcalloc: zero size");
 	ptr = calloc(nmemb, size);
@@ -52,16 +69,17 @@ xcalloc(size_t nmemb, size_t size)
 }
 
 void *
-xrealloc(void *ptr, size_t size)
+xrealloc_at(struct asite *as, void *ptr, size_t size)
 {
-	return xreallocarray(ptr, 1, size);
+	return xreallocarray_at(as, ptr, 1, size);
 }
 
 void *
-xreallocarray(void *ptr, size_t nmemb, size_t size)
+xreallocarray_at(struct asite *as, void *ptr, size_t nmemb, size_t size)
 {
 	void *new_ptr;
 
+	asite_add(as, nmemb * size);
 	if (nmemb == 0 || size == 0)
 		errx(1, "xreallocarray: zero size");
 	new_ptr = reallocarray(ptr, nmemb, size);
@@ -72,10 +90,11 @@ xreallocarray(void *ptr, size_t nmemb, size_t size)
 }
 
 char *
-xstrdup(const char *str)
+xstrdup_at(struct asite *as, const char *str)
 {
 	char *cp;
 
+	asite_add(as, strlen(str) + 1);
 	if ((cp = strdup(str)) == NULL)
 		err(1, "xstrdup");
 	return cp;